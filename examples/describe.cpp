@@ -98,7 +98,7 @@ int main(int argc, char* argv[])
   bands.init(minFreq, maxFreq, nBands, nBins, samplingRate, windowSize);
   dct.init(nBands, nCoefs);
   stats.init(0, 0, 50, 100);
-  loudness.init(windowSize, samplingRate);
+  loudness.init(windowSize, samplingRate, hopSize);
 
   RealVector in(nSamples);
   file.readChannel(in.data(), nSamples, 0);
@@ -53,7 +53,7 @@ public:
         return std::fmod(x + 10* nChroma + halfChroma, nChroma) - halfChroma;
     });
     MatrixXd filters = (-0.5 * (2 * remainder / widths.replicate(1, nChroma).transpose()).square()).exp();
-    filters = filters.block(0, 0, nChroma, nBins);
+    filters = filters.block(0, 0, nChroma, nBins).eval();
     filters.colwise().normalize();
     mFiltersStorage.setZero();
     mFiltersStorage.block(0, 0, nChroma, nBins) = filters;
@@ -29,14 +29,21 @@ public:
 
   enum HPSSMode { kClassic, kCoupled, kAdvanced };
 
-  HPSS(index maxFFTSize, index maxHSize)
+  HPSS(index maxFFTSize, index maxHSize, index maxVSize)
       : mMaxH(maxFFTSize / 2 + 1, maxHSize),
         mMaxV(maxFFTSize / 2 + 1, maxHSize),
-        mMaxBuf(maxFFTSize / 2 + 1, maxHSize)
+        mMaxBuf(maxFFTSize / 2 + 1, maxHSize), mVFilter(maxVSize),
+        mMag(maxFFTSize / 2 + 1), mHarmonicMask(maxFFTSize / 2 + 1),
+        mPercussiveMask(maxFFTSize / 2 + 1), mResidualMask(maxFFTSize / 2 + 1),
+        mMaskNorm(maxFFTSize / 2 + 1), mHThreshold(maxFFTSize / 2 + 1),
+        mPThreshold(maxFFTSize / 2 + 1)
   {
     mMaxH.setZero();
     mMaxV.setZero();
     mMaxBuf.setZero();
+    mHFilters.reserve(asUnsigned(maxFFTSize / 2 + 1));
+    for (index i = 0; i < maxFFTSize / 2 + 1; i++)
+      mHFilters.emplace_back(maxHSize);
   }
 
   void init(index nBins, index hSize)
@@ -46,14 +53,12 @@ public:
     assert(nBins <= mMaxBuf.rows());
     assert(hSize <= mMaxBuf.cols());
 
-    mH = mMaxH.block(0, 0, nBins, hSize);
-    mV = mMaxV.block(0, 0, nBins, hSize);
-    mBuf = mMaxBuf.block(0, 0, nBins, hSize);
-    mH.setZero();
-    mV.setZero();
-    mBuf.setZero();
+    mMaxH.block(0, 0, nBins, hSize).setZero();
+    mMaxV.block(0, 0, nBins, hSize).setZero();
+    mMaxBuf.block(0, 0, nBins, hSize).setZero();
+    mHSize = hSize;
+    mReadPos = 0;
 
-    mHFilters = std::vector<MedianFilter>(asUnsigned(nBins));
     for (index i = 0; i < nBins; i++) { mHFilters[asUnsigned(i)].init(hSize); }
     mInitialized = true;
   }
@@ -67,87 +72,87 @@ public:
   {
     using namespace Eigen;
     assert(mInitialized);
-
-    index    h2 = (hSize - 1) / 2;
-    index    v2 = (vSize - 1) / 2;
-    index    nBins = in.size();
-    ArrayXcd frame = _impl::asEigen<Array>(in);
-    ArrayXd  mag = frame.abs().real();
-
-    mV.block(0, 0, nBins, hSize - 1) = mV.block(0, 1, nBins, hSize - 1);
-    mH.block(0, 0, nBins, hSize - 1) = mH.block(0, 1, nBins, hSize - 1);
-    mBuf.block(0, 0, nBins, hSize - 1) = mBuf.block(0, 1, nBins, hSize - 1);
-
-    ArrayXd padded = ArrayXd::Zero(2 * vSize + nBins);
-    ArrayXd resultV = ArrayXd::Zero(padded.size());
-    ArrayXd tmp = ArrayXd::Zero(padded.size());
-
-    padded.segment(v2, nBins) = mag;
-    mVFilter.init(vSize);
-    for (index i = 0; i < padded.size(); i++)
-    { tmp(i) = mVFilter.processSample(padded(i)); }
-    mV.block(0, hSize - 1, nBins, 1) = tmp.segment(v2 * 3, nBins);
-    mBuf.block(0, hSize - 1, nBins, 1) = frame;
-    ArrayXd tmpRow = ArrayXd::Zero(2 * hSize);
+    assert(hSize == mHSize);
+
+    index h2 = (hSize - 1) / 2;
+    index nBins = in.size();
+    auto  frame = _impl::asEigen<Array>(in);
+    auto  result = _impl::asEigen<Array>(out);
+
+    // The history matrices are rings of hSize columns. A column written
+    // d frames ahead of the read position comes back round d frames later.
+    index readPos = mReadPos;
+    index bufferPos = (readPos + hSize - 1) % hSize;
+    index harmonicPos = (readPos + h2 + 1) % hSize;
+    mReadPos = (readPos + 1) % hSize;
+
+    auto mag = mMag.head(nBins);
+    mag = frame.col(0).abs();
+
+    if (!mVFilter.initialized() || mVFilter.size() != vSize)
+      mVFilter.init(vSize);
+    mVFilter.process(mag, mMaxV.col(bufferPos).head(nBins), vSize - 1);
+    mMaxBuf.col(bufferPos).head(nBins) = frame.col(0);
     for (index i = 0; i < nBins; i++)
-    { mH(i, h2 + 1) = mHFilters[asUnsigned(i)].processSample(mag(i)); }
-    ArrayXXcd result(nBins, 3);
-    ArrayXd   harmonicMask = ArrayXd::Ones(nBins);
-    ArrayXd   percussiveMask = ArrayXd::Ones(nBins);
-    ArrayXd   residualMask =
-        mode == kAdvanced ? ArrayXd::Ones(nBins) : ArrayXd::Zero(nBins);
+    {
+      mMaxH(i, harmonicPos) =
+          mHFilters[asUnsigned(i)].processSample(mag(i));
+    }
+
+    auto H = mMaxH.col(readPos).head(nBins);
+    auto V = mMaxV.col(readPos).head(nBins);
+    auto harmonicMask = mHarmonicMask.head(nBins);
+    auto percussiveMask = mPercussiveMask.head(nBins);
+    auto residualMask = mResidualMask.head(nBins);
     switch (mode)
     {
     case kClassic: {
-      ArrayXd HV = mH.col(0) + mV.col(0);
-      ArrayXd mult = (1.0 / HV.max(epsilon));
-      harmonicMask = (mH.col(0) * mult);
-      percussiveMask = (mV.col(0) * mult);
+      harmonicMask = H * (1.0 / (H + V).max(epsilon));
+      percussiveMask = V * (1.0 / (H + V).max(epsilon));
+      residualMask.setZero();
       break;
     }
     case kCoupled: {
-      harmonicMask = ((mH.col(0) / mV.col(0)) >
-                      makeThreshold(nBins, hThresholdX1, hThresholdY1,
-                                    hThresholdX2, hThresholdY2))
-                         .cast<double>();
+      makeThreshold(mHThreshold.head(nBins), hThresholdX1, hThresholdY1,
+                    hThresholdX2, hThresholdY2);
+      harmonicMask = ((H / V) > mHThreshold.head(nBins)).cast<double>();
       percussiveMask = 1 - harmonicMask;
+      residualMask.setZero();
       break;
     }
     case kAdvanced: {
-      harmonicMask = ((mH.col(0) / mV.col(0)) >
-                      makeThreshold(nBins, hThresholdX1, hThresholdY1,
-                                    hThresholdX2, hThresholdY2))
-                         .cast<double>();
-      percussiveMask = ((mV.col(0) / mH.col(0)) >
-                        makeThreshold(nBins, pThresholdX1, pThresholdY1,
-                                      pThresholdX2, pThresholdY2))
-                           .cast<double>();
-      residualMask = residualMask * (1 - harmonicMask);
-      residualMask = residualMask * (1 - percussiveMask);
-      ArrayXd maskNorm =
+      makeThreshold(mHThreshold.head(nBins), hThresholdX1, hThresholdY1,
+                    hThresholdX2, hThresholdY2);
+      makeThreshold(mPThreshold.head(nBins), pThresholdX1, pThresholdY1,
+                    pThresholdX2, pThresholdY2);
+      harmonicMask = ((H / V) > mHThreshold.head(nBins)).cast<double>();
+      percussiveMask = ((V / H) > mPThreshold.head(nBins)).cast<double>();
+      residualMask = (1 - harmonicMask) * (1 - percussiveMask);
+      auto maskNorm = mMaskNorm.head(nBins);
+      maskNorm =
           (1. / (harmonicMask + percussiveMask + residualMask)).max(epsilon);
-      harmonicMask = harmonicMask * maskNorm;
-      percussiveMask = percussiveMask * maskNorm;
-      residualMask = residualMask * maskNorm;
+      harmonicMask *= maskNorm;
+      percussiveMask *= maskNorm;
+      residualMask *= maskNorm;
       break;
     }
     }
-    result.col(0) = mBuf.col(0) * harmonicMask.min(1.0);
-    result.col(1) = mBuf.col(0) * percussiveMask.min(1.0);
-    result.col(2) = mBuf.col(0) * residualMask.min(1.0);
-    out = _impl::asFluid(result);
+    auto delayed = mMaxBuf.col(readPos).head(nBins);
+    result.col(0) = delayed * harmonicMask.min(1.0);
+    result.col(1) = delayed * percussiveMask.min(1.0);
+    result.col(2) = delayed * residualMask.min(1.0);
   }
   bool initialized() { return mInitialized; }
 
 private:
-  Eigen::ArrayXd makeThreshold(index nBins, double x1, double y1, double x2,
-                               double y2)
+  void makeThreshold(Eigen::Ref<Eigen::ArrayXd> threshold, double x1,
+                     double y1, double x2, double y2)
   {
     using namespace Eigen;
-    ArrayXd threshold = ArrayXd::Ones(nBins);
-    index   kneeStart = static_cast<index>(std::floor(x1 * nBins));
-    index   kneeEnd = static_cast<index>(std::floor(x2 * nBins));
-    index   kneeLength = kneeEnd - kneeStart;
+    index nBins = threshold.size();
+    index kneeStart = static_cast<index>(std::floor(x1 * nBins));
+    index kneeEnd = static_cast<index>(std::floor(x2 * nBins));
+    index kneeLength = kneeEnd - kneeStart;
     threshold.segment(0, kneeStart) =
         ArrayXd::Constant(kneeStart, 10).pow(y1 / 20.0);
     threshold.segment(kneeStart, kneeLength) =
@@ -155,19 +160,24 @@ private:
             .pow(ArrayXd::LinSpaced(kneeLength, y1, y2) / 20.0);
     threshold.segment(kneeEnd, nBins - kneeEnd) =
         ArrayXd::Constant(nBins - kneeEnd, 10).pow(y2 / 20.0);
-    return threshold;
   }
 
   std::vector<MedianFilter> mHFilters;
-  MedianFilter              mVFilter;
-
-  ArrayXXd  mMaxH;
-  ArrayXXd  mMaxV;
-  ArrayXXcd mMaxBuf;
-  ArrayXXd  mV;
-  ArrayXXd  mH;
-  ArrayXXcd mBuf;
-  bool      mInitialized{false};
+
+  ArrayXXd       mMaxH;
+  ArrayXXd       mMaxV;
+  ArrayXXcd      mMaxBuf;
+  MedianFilter   mVFilter;
+  Eigen::ArrayXd mMag;
+  Eigen::ArrayXd mHarmonicMask;
+  Eigen::ArrayXd mPercussiveMask;
+  Eigen::ArrayXd mResidualMask;
+  Eigen::ArrayXd mMaskNorm;
+  Eigen::ArrayXd mHThreshold;
+  Eigen::ArrayXd mPThreshold;
+  index          mHSize{0};
+  index          mReadPos{0};
+  bool           mInitialized{false};
 };
 } // namespace algorithm
 } // namespace fluid
@@ -16,6 +16,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
+#include <algorithm>
 #include <queue>
 #include <memory>
 #include <string>
@@ -38,11 +39,14 @@ public:
                                        std::less<knnCandidate>>;
   using iterator = const std::vector<index>::iterator;
 
+  // row is the point's position in the data the tree was built from (or
+  // loaded from, with fromFlat), or its order of addition with addNode
   struct Node
   {
     const string     id;
     const RealVector data;
     NodePtr          left{nullptr}, right{nullptr};
+    const index      row;
   };
 
   struct FlatData
@@ -72,33 +76,35 @@ public:
 
   void addNode(string id, ConstRealVectorView data)
   {
-    mRoot = addNode(mRoot.get(), id, data, 0);
+    mRoot = addNode(mRoot.get(), id, data, mNPoints, 0);
     mNPoints++;
   }
 
   DataSet kNearest(ConstRealVectorView data, index k = 1,
                    double radius = 0) const
   {
-    assert(data.size() == mDims);
-    knnQueue queue;
-    auto     result = DataSet(1);
-    kNearest(mRoot.get(), data, queue, k, radius, 0);
-    index                     numFound = asSigned(queue.size());
-    std::vector<knnCandidate> sorted(asUnsigned(numFound));
-    for (index i = numFound - 1; i >= 0; i--)
-    {
-      sorted[asUnsigned(i)] = queue.top();
-      queue.pop();
-    }
-    for (index i = 0; i < numFound; i++)
+    std::vector<knnCandidate> sorted;
+    kNearest(data, k, sorted, radius);
+    auto result = DataSet(1);
+    for (auto& neighbour : sorted)
     {
-      auto dist = FluidTensor<double, 1>{sorted[asUnsigned(i)].first};
-      auto id = sorted[asUnsigned(i)].second->id;
-      result.add(id, dist);
+      auto dist = FluidTensor<double, 1>{neighbour.first};
+      result.add(neighbour.second->id, dist);
     }
     return result;
   }
 
+  /// Fills neighbours with (distance, node) pairs, nearest first. This doesn't
+  /// allocate once neighbours has capacity for k, so suits real-time use
+  void kNearest(ConstRealVectorView data, index k,
+                std::vector<knnCandidate>& neighbours, double radius = 0) const
+  {
+    assert(data.size() == mDims);
+    neighbours.clear();
+    kNearest(mRoot.get(), data, neighbours, k, radius, 0);
+    std::sort_heap(neighbours.begin(), neighbours.end());
+  }
+
   void  print() const { print(mRoot.get(), 0); }
   index dims() const { return mDims; }
   index size() const { return mNPoints; }
@@ -134,7 +140,8 @@ private:
       return nullptr;
     else if (std::distance(from, to) == 1)
     {
-      return makeNode(dataset.getIds()(*from), dataset.getData().row(*from));
+      return makeNode(dataset.getIds()(*from), dataset.getData().row(*from),
+                      *from);
     }
     const index d = depth % mDims;
     sort(from, to, [&](index a, index b) {
@@ -143,7 +150,8 @@ private:
     const index range = std::distance(from, to);
     const index median = range / 2;
     NodePtr     current = makeNode(dataset.getIds().row(*(from + median)),
-                               dataset.getData().row(*(from + median)));
+                               dataset.getData().row(*(from + median)),
+                               *(from + median));
     if (median > 0)
       current->left =
           buildTree(indices, from, from + median, dataset, depth + 1);
@@ -153,22 +161,27 @@ private:
     return current;
   }
 
-  NodePtr makeNode(string id, ConstRealVectorView data) const
+  NodePtr makeNode(string id, ConstRealVectorView data, index row) const
   {
-    return std::make_shared<Node>(Node{id, RealVector{data}, nullptr, nullptr});
+    return std::make_shared<Node>(
+        Node{id, RealVector{data}, nullptr, nullptr, row});
   }
 
   NodePtr addNode(Node* current, string id, ConstRealVectorView data,
-                  const index depth) const
+                  index row, const index depth) const
   {
-    if (current == nullptr) { return makeNode(id, data); }
+    if (current == nullptr) { return makeNode(id, data, row); }
 
     const index d = depth % mDims;
     if (data(d) < current->data(d))
-    { current->left = addNode(current->left.get(), id, data, depth + 1); }
+    {
+      current->left =
+          addNode(current->left.get(), id, data, row, depth + 1);
+    }
     else
     {
-      current->right = addNode(current->right.get(), id, data, depth + 1);
+      current->right =
+          addNode(current->right.get(), id, data, row, depth + 1);
     }
     return NodePtr(current);
   }
@@ -198,18 +211,24 @@ private:
     print(current->right.get(), depth + 1);
   }
 
-  void kNearest(const Node* current, ConstRealVectorView data, knnQueue& knn,
-                index k, double radius, index depth) const
+  // knn is a max-heap on distance, so its front is the furthest candidate
+  void kNearest(const Node* current, ConstRealVectorView data,
+                std::vector<knnCandidate>& knn, index k, double radius,
+                index depth) const
   {
     if (current == nullptr) return;
     const double currentDist = distance(current->data, data);
     bool         withinRadius = radius > 0 ? currentDist < radius : true;
     if (withinRadius && (knn.size() < asUnsigned(k) || k == 0))
-    { knn.push(std::make_pair(currentDist, current)); }
-    else if (withinRadius && currentDist < knn.top().first)
     {
-      knn.pop();
-      knn.push(std::make_pair(currentDist, current));
+      knn.emplace_back(currentDist, current);
+      std::push_heap(knn.begin(), knn.end());
+    }
+    else if (withinRadius && currentDist < knn.front().first)
+    {
+      std::pop_heap(knn.begin(), knn.end());
+      knn.back() = std::make_pair(currentDist, current);
+      std::push_heap(knn.begin(), knn.end());
     }
     const index  d = depth % mDims;
     const double dimDif = current->data(d) - data(d);
@@ -222,7 +241,7 @@ private:
     }
     kNearest(firstBranch, data, knn, k, radius, depth + 1);
     if (k == 0 || knn.size() < asUnsigned(k) ||
-        dimDif < knn.top().first) // ball centered at query with diametre
+        dimDif < knn.front().first) // ball centered at query with diametre
                                   // kthDist intersects with current partition
                                   // (or need to get more neighbors)
     { kNearest(secondBranch, data, knn, k, radius, depth + 1); }
@@ -253,7 +272,7 @@ private:
   NodePtr unflatten(const FlatData& store, index index) const
   {
     if (index == -1) return nullptr;
-    NodePtr current = makeNode(store.ids[index], store.data[index]);
+    NodePtr current = makeNode(store.ids[index], store.data[index], index);
     current->left = unflatten(store, store.tree(index, 0));
     current->right = unflatten(store, store.tree(index, 1));
     return current;
@@ -10,21 +10,38 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #pragma once
 
-#include "../util/DistanceFuncs.hpp"
+#include "../util/AlgorithmUtils.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
+#include "../util/RandomGenerator.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <random>
 #include <string>
 
 namespace fluid {
 namespace algorithm {
 
+// Lloyd's algorithm, seeded by k-means++ (Arthur and Vassilvitskii, 2007),
+// with Hamerly's (2010) bounds: each point keeps an upper bound on the
+// distance to its mean and a lower bound on the distance to any other, so
+// that most points are not compared against every mean at each iteration.
+// Assignment and accumulation are shared between threads. Alternatively,
+// mini-batch k-means (Sculley, 2010) updates the means from a random batch of
+// points at a time, with a per-mean learning rate of 1 / (points seen)
 class KMeans
 {
+  using ArrayXd = Eigen::ArrayXd;
+  using ArrayXXd =
+      Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using ArrayXi = Eigen::ArrayXi;
 
 public:
   void clear()
@@ -36,34 +53,48 @@ public:
 
   bool initialized() const { return mTrained; }
 
+  /// batchSize > 0 selects mini-batch training; training stops after
+  /// maxIter iterations (or batches), when no assignment changes, or when no
+  /// mean moves by more than tolerance. numThreads = 0 uses all cores, and a
+  /// seed >= 0 makes the seeding and batches reproducible
   void train(const FluidDataSet<std::string, double, 1>& dataset, index k,
-             index maxIter)
+             index maxIter, index batchSize = 0, double tolerance = 0,
+             index numThreads = 0, index seed = -1)
   {
     using namespace Eigen;
     using namespace _impl;
     assert(!mTrained || (dataset.pointSize() == mDims && mK == k));
     auto dataPoints = asEigen<Array>(dataset.getData());
-    if (mTrained) { mAssignments = assignClusters(dataPoints); }
-    else
+    index n = dataPoints.rows();
+    bool  miniBatch = batchSize > 0 && batchSize < n;
+    mThreads = numThreads > 0 ? numThreads : hardwareThreads();
+    mRandomGenerator = makeGenerator(seed);
+    if (!mTrained)
     {
       mK = k;
       mDims = dataset.pointSize();
-      mMeans = ArrayXXd::Zero(mK, mDims);
-      mEmpty = std::vector<bool>(asUnsigned(mK), false);
-      mAssignments =
-          ((0.5 + (0.5 * ArrayXf::Random(dataPoints.rows()))) * (mK - 1))
-              .round()
-              .cast<int>();
+      if (miniBatch)
+      {
+        // seed from a random sample, rather than from the whole dataset
+        index sampleSize = std::min(n, 3 * std::max(batchSize, mK));
+        std::uniform_int_distribution<index> randomPoint(0, n - 1);
+        ArrayXXd                             sample(sampleSize, mDims);
+        for (index i = 0; i < sampleSize; i++)
+          sample.row(i) = dataPoints.row(randomPoint(mRandomGenerator));
+        initMeans(sample);
+      }
+      else
+        initMeans(dataPoints);
     }
-
-    while (maxIter-- > 0)
+    if (miniBatch)
+      trainMiniBatch(dataPoints, batchSize, maxIter, tolerance);
+    else
     {
-      computeMeans(dataPoints);
-      auto assignments = assignClusters(dataPoints);
-      if (!changed(assignments)) { break; }
-      else
+      initBounds(dataPoints);
+      while (maxIter-- > 0)
       {
-        mAssignments = assignments;
+        if (computeMeans(dataPoints) <= tolerance) break;
+        if (!assignClusters(dataPoints)) break;
       }
     }
     mTrained = true;
@@ -82,7 +113,7 @@ public:
   index vq(RealVectorView point) const
   {
     assert(point.size() == mDims);
-    return assignPoint(_impl::asEigen<Eigen::Array>(point));
+    return nearest(_impl::asEigen<Eigen::Array>(point).transpose());
   }
 
   void getMeans(RealMatrixView out) const
@@ -95,7 +126,6 @@ public:
     mMeans = _impl::asEigen<Eigen::Array>(means);
     mDims = mMeans.cols();
     mK = mMeans.rows();
-    mEmpty = std::vector<bool>(asUnsigned(mK), false);
     mTrained = true;
   }
 
@@ -109,28 +139,46 @@ public:
     out = _impl::asFluid(mAssignments);
   }
 
-  void getDistances(RealMatrixView data, RealMatrixView out) const
+  /// Nearest mean for each row of data, on numThreads threads (0 for all
+  /// cores)
+  void vq(RealMatrixView data, FluidTensorView<index, 1> out,
+          index numThreads = 0) const
   {
-    Eigen::ArrayXXd points = _impl::asEigen<Eigen::Array>(data);
-    Eigen::ArrayXXd D = fluid::algorithm::DistanceMatrix(points, 2);
-    Eigen::MatrixXd means = mMeans.matrix();
-    D = fluid::algorithm::DistanceMatrix<Eigen::ArrayXXd>(points, mMeans, 2);
-    out = _impl::asFluid(D);
+    assert(data.cols() == mDims && out.size() == data.rows());
+    forEachBlock(data, numThreads, [&](auto& distances, index start) {
+      for (index i = 0; i < distances.rows(); i++)
+        distances.row(i).minCoeff(&out(start + i));
+    });
+  }
+
+  /// Squared distances from each row of data to each mean, on numThreads
+  /// threads (0 for all cores)
+  void getDistances(RealMatrixView data, RealMatrixView out,
+                    index numThreads = 0) const
+  {
+    assert(data.cols() == mDims && out.rows() == data.rows() &&
+           out.cols() == mK);
+    auto result = _impl::asEigen<Eigen::Matrix>(out);
+    forEachBlock(data, numThreads, [&](auto& distances, index start) {
+      result.middleRows(start, distances.rows()) = distances;
+    });
   }
 
 private:
-  double distance(Eigen::ArrayXd v1, Eigen::ArrayXd v2) const
+  template <typename Point>
+  double distance(const Point& point, index k) const
   {
-    return (v1 - v2).matrix().norm();
+    return (point - mMeans.row(k)).matrix().norm();
   }
 
-  index assignPoint(Eigen::ArrayXd point) const
+  template <typename Point>
+  index nearest(const Point& point) const
   {
     double minDistance = std::numeric_limits<double>::infinity();
-    index  minK;
+    index  minK = 0;
     for (index k = 0; k < mK; k++)
     {
-      double dist = distance(point, mMeans.row(k));
+      double dist = distance(point, k);
       if (dist < minDistance)
       {
         minK = k;
@@ -140,52 +188,259 @@ private:
     return minK;
   }
 
-  Eigen::VectorXi assignClusters(Eigen::ArrayXXd dataPoints) const
+  // squared distances from blocks of rows of data to the means, as
+  // |x|^2 + |m|^2 - 2 x.m, i.e. one matrix product per block; blocks are
+  // shared between numThreads threads and passed to func(distances, firstRow)
+  template <typename Func>
+  void forEachBlock(RealMatrixView data, index numThreads, Func&& func) const
   {
-    Eigen::VectorXi assignments = Eigen::VectorXi::Zero(dataPoints.rows());
-    for (index i = 0; i < dataPoints.rows(); i++)
-    { assignments(i) = static_cast<int>(assignPoint(dataPoints.row(i))); }
-    return assignments;
+    using namespace Eigen;
+    constexpr index blockSize = 1024;
+    auto            points = _impl::asEigen<Matrix>(data);
+    index           n = points.rows();
+    VectorXd        meanNorms = mMeans.matrix().rowwise().squaredNorm();
+    auto            processBlock = [&](index block) {
+      index    start = block * blockSize;
+      index    size = std::min(blockSize, n - start);
+      auto     rows = points.middleRows(start, size);
+      MatrixXd distances(size, mK);
+      distances.noalias() = -2.0 * rows * mMeans.matrix().transpose();
+      distances.colwise() += rows.rowwise().squaredNorm();
+      distances.rowwise() += meanNorms.transpose();
+      distances = distances.cwiseMax(0.0);
+      func(distances, start);
+    };
+    parallelFor((n + blockSize - 1) / blockSize, processBlock,
+                numThreads > 0 ? numThreads : hardwareThreads());
   }
 
-  void computeMeans(Eigen::ArrayXXd dataPoints)
+  // k-means++: each mean is drawn from the points with probability
+  // proportional to the squared distance to the nearest mean so far
+  template <typename Data>
+  void initMeans(const Data& dataPoints)
   {
-    using namespace Eigen;
+    index n = dataPoints.rows();
+    std::uniform_int_distribution<index>   randomPoint(0, n - 1);
+    std::uniform_real_distribution<double> uniform;
+    mMeans.resize(mK, mDims);
+    mMeans.row(0) = dataPoints.row(randomPoint(mRandomGenerator));
+    ArrayXd weights = ArrayXd::Constant(n, infinity);
+    for (index k = 1; k < mK; k++)
+    {
+      forEachChunk(n, [&](index start, index end, index) {
+        for (index i = start; i < end; i++)
+        {
+          weights(i) =
+              std::min(weights(i),
+                       (dataPoints.row(i) - mMeans.row(k - 1)).square().sum());
+        }
+      });
+      double total = weights.sum();
+      index  next = 0;
+      if (total > 0)
+      {
+        double target = uniform(mRandomGenerator) * total;
+        double sum = 0;
+        while (next < n - 1 && (sum += weights(next)) <= target) next++;
+      }
+      else
+        next = randomPoint(mRandomGenerator); // fewer distinct points than k
+      mMeans.row(k) = dataPoints.row(next);
+    }
+  }
+
+  // split [0, n) into contiguous chunks of at least minChunk points, at most
+  // mMaxChunks, and call func(start, end, chunk) on each, sharing them between
+  // threads; returns the number of chunks. The split depends only on n, so
+  // per-chunk partial sums add up the same however many threads there are
+  template <typename Func>
+  index forEachChunk(index n, Func&& func, index minChunk = 1024) const
+  {
+    index chunks = std::max<index>(std::min(mMaxChunks, n / minChunk), 1);
+    parallelFor(
+        chunks,
+        [&](index c) { func(n * c / chunks, n * (c + 1) / chunks, c); },
+        mThreads);
+    return chunks;
+  }
+
+  // assign every point from scratch, with tight bounds
+  template <typename Data>
+  void initBounds(const Data& dataPoints)
+  {
+    index n = dataPoints.rows();
+    mAssignments.resize(n);
+    mUpper.resize(n);
+    mLower.resize(n);
+    mSums.resize(mK * mMaxChunks, mDims);
+    mCounts.resize(mK * mMaxChunks);
+    mMovement.resize(mK);
+    mHalfSeparation.resize(mK);
+    forEachChunk(n, [&](index start, index end, index) {
+      for (index i = start; i < end; i++) assignPoint(dataPoints.row(i), i);
+    });
+  }
+
+  // exhaustive search for point i, keeping the two nearest distances (compared
+  // squared)
+  template <typename Point>
+  bool assignPoint(const Point& point, index i)
+  {
+    double first = infinity, second = infinity;
+    index  best = 0;
     for (index k = 0; k < mK; k++)
     {
-      if (mEmpty[asUnsigned(k)]) continue;
-      std::vector<index> kAssignment;
-      for (index i = 0; i < mAssignments.size(); i++)
+      double dist = (point - mMeans.row(k)).square().sum();
+      if (dist < first)
       {
-        if (mAssignments(i) == k) kAssignment.push_back(i);
+        second = first;
+        first = dist;
+        best = k;
       }
-      if (kAssignment.size() == 0)
+      else if (dist < second)
+        second = dist;
+    }
+    bool changed = best != mAssignments(i);
+    mAssignments(i) = static_cast<int>(best);
+    mUpper(i) = std::sqrt(first);
+    mLower(i) = std::sqrt(second);
+    return changed;
+  }
+
+  // recompute the means from sums accumulated in one pass over the data (one
+  // block of sums per chunk), and loosen the bounds by how far the means
+  // moved; returns the largest movement
+  template <typename Data>
+  double computeMeans(const Data& dataPoints)
+  {
+    index n = dataPoints.rows();
+    mSums.setZero();
+    mCounts.setZero();
+    index chunks = forEachChunk(n, [&](index start, index end, index chunk) {
+      index offset = chunk * mK;
+      for (index i = start; i < end; i++)
+      {
+        mSums.row(offset + mAssignments(i)) += dataPoints.row(i);
+        mCounts(offset + mAssignments(i))++;
+      }
+    });
+    index  maxMoved = 0;
+    double secondMovement = 0;
+    for (index k = 0; k < mK; k++)
+    {
+      for (index c = 1; c < chunks; c++)
+      {
+        mSums.row(k) += mSums.row(c * mK + k);
+        mCounts(k) += mCounts(c * mK + k);
+      }
+      mMovement(k) = 0;
+      if (mCounts(k) == 0) continue; // an empty cluster keeps its mean
+      mSums.row(k) /= static_cast<double>(mCounts(k));
+      mMovement(k) = (mSums.row(k) - mMeans.row(k)).matrix().norm();
+      mMeans.row(k) = mSums.row(k);
+    }
+    for (index k = 1; k < mK; k++)
+    {
+      if (mMovement(k) > mMovement(maxMoved))
+      {
+        secondMovement = mMovement(maxMoved);
+        maxMoved = k;
+      }
+      else if (mMovement(k) > secondMovement)
+        secondMovement = mMovement(k);
+    }
+    forEachChunk(n, [&](index start, index end, index) {
+      for (index i = start; i < end; i++)
+      {
+        index a = mAssignments(i);
+        mUpper(i) += mMovement(a);
+        mLower(i) -= a == maxMoved ? secondMovement : mMovement(maxMoved);
+      }
+    });
+    return mMovement(maxMoved);
+  }
+
+  // returns whether any assignment changed
+  template <typename Data>
+  bool assignClusters(const Data& dataPoints)
+  {
+    for (index k = 0; k < mK; k++)
+    {
+      double minDistance = infinity;
+      for (index j = 0; j < mK; j++)
       {
-        std::cout << "Warning: empty cluster" << std::endl;
-        mEmpty[asUnsigned(k)] = true;
-        return;
+        if (j != k)
+          minDistance = std::min(minDistance, distance(mMeans.row(j), k));
       }
-      ArrayXXd clusterPoints =
-          ArrayXXd::Zero(asSigned(kAssignment.size()), mDims);
-      for (index i = 0; asUnsigned(i) < kAssignment.size(); i++)
-      { clusterPoints.row(i) = dataPoints.row(kAssignment[asUnsigned(i)]); }
-      ArrayXd mean = clusterPoints.colwise().mean();
-      mMeans.row(k) = mean;
+      mHalfSeparation(k) = 0.5 * minDistance;
     }
+    std::atomic<bool> changed{false};
+    forEachChunk(dataPoints.rows(), [&](index start, index end, index) {
+      bool chunkChanged = false;
+      for (index i = start; i < end; i++)
+      {
+        double bound = std::max(mHalfSeparation(mAssignments(i)), mLower(i));
+        if (mUpper(i) <= bound) continue;
+        mUpper(i) = distance(dataPoints.row(i), mAssignments(i));
+        if (mUpper(i) <= bound) continue;
+        chunkChanged = assignPoint(dataPoints.row(i), i) || chunkChanged;
+      }
+      if (chunkChanged) changed = true;
+    });
+    return changed;
   }
 
-  bool changed(Eigen::VectorXi newAssignments) const
+  // each batch is assigned against the current means, then every point in
+  // it moves its mean towards itself by 1 / (number of points seen by it)
+  template <typename Data>
+  void trainMiniBatch(const Data& dataPoints, index batchSize, index maxIter,
+                      double tolerance)
   {
-    auto dif = (newAssignments - mAssignments).cwiseAbs().sum();
-    return dif > 0;
+    std::uniform_int_distribution<index> randomPoint(0, dataPoints.rows() - 1);
+    mBatch.resize(batchSize);
+    mBatchAssignments.resize(batchSize);
+    mCounts.setZero(mK);
+    mSums.resize(mK, mDims);
+    while (maxIter-- > 0)
+    {
+      for (index b = 0; b < batchSize; b++)
+        mBatch(b) = randomPoint(mRandomGenerator);
+      forEachChunk(batchSize, [&](index start, index end, index) {
+        for (index b = start; b < end; b++)
+          mBatchAssignments(b) =
+              static_cast<int>(nearest(dataPoints.row(mBatch(b))));
+      });
+      mSums = mMeans; // to measure how far the means move
+      for (index b = 0; b < batchSize; b++)
+      {
+        index k = mBatchAssignments(b);
+        mCounts(k)++;
+        mMeans.row(k) += (dataPoints.row(mBatch(b)) - mMeans.row(k)) /
+                         static_cast<double>(mCounts(k));
+      }
+      double moved = (mMeans - mSums).square().rowwise().sum().maxCoeff();
+      if (std::sqrt(moved) <= tolerance) break;
+    }
+    initBounds(dataPoints);
   }
 
-  index             mK{0};
-  index             mDims{0};
-  Eigen::ArrayXXd   mMeans;
-  std::vector<bool> mEmpty;
-  Eigen::VectorXi   mAssignments;
-  bool              mTrained{false};
+  index           mK{0};
+  index           mDims{0};
+  ArrayXXd        mMeans;
+  Eigen::VectorXi mAssignments;
+  bool            mTrained{false};
+
+  index        mThreads{1};
+  index        mMaxChunks{16};
+  std::mt19937 mRandomGenerator;
+  ArrayXd      mUpper;
+  ArrayXd      mLower;
+  ArrayXXd     mSums;
+  ArrayXi      mCounts;
+  ArrayXd      mMovement;
+  ArrayXd      mHalfSeparation;
+  Eigen::Array<index, Eigen::Dynamic, 1> mBatch;
+  ArrayXi                                mBatchAssignments;
 };
 } // namespace algorithm
 } // namespace fluid
@@ -28,16 +28,17 @@ class Loudness
 public:
   Loudness(index maxSize) : mTP(maxSize) {}
 
-  void init(index size, double sampleRate)
+  void init(index size, double sampleRate, index hopSize)
   {
     mFilter.init(sampleRate);
-    mTP.init(size, sampleRate);
+    mTP.init(size, sampleRate, hopSize);
     mSize = size;
     mInitialized = true;
   }
 
   void processFrame(const RealVectorView& input, RealVectorView output,
-                    bool weighting, bool truePeak)
+                    bool weighting, bool truePeak,
+                    index truePeakMethod = TruePeak::kPolyphase)
   {
     using namespace Eigen;
     using namespace std;
@@ -49,7 +50,7 @@ public:
     for (index i = 0; i < mSize; i++)
       filtered(i) = weighting ? mFilter.processSample(in(i)) : in(i);
     double loudness = -0.691 + 10 * log10(filtered.square().mean() + epsilon);
-    double peak = truePeak ? mTP.processFrame(input) : in.abs().maxCoeff();
+    double peak = truePeak ? mTP.processFrame(input, truePeakMethod) : in.abs().maxCoeff();
     peak = 20 * log10(peak + epsilon);
     output(0) = loudness;
     output(1) = peak;
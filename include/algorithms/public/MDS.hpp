@@ -12,45 +12,119 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "../util/DistanceFuncs.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
+#include "../util/TruncatedEigen.hpp"
+#include "../../data/FluidIndex.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
-#include <Eigen/SVD>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
 
+// Classical MDS of the double-centred distance matrix, or, given a number of
+// landmarks, landmark MDS (de Silva and Tenenbaum, 2004): only the landmarks
+// are embedded classically and every point is placed from its distances to
+// them, so the cost grows with n * landmarks rather than n^2. Landmarks are
+// chosen by MaxMin, each being the point farthest from those already chosen
 class MDS
 {
 public:
   using MatrixXd = Eigen::MatrixXd;
   using VectorXd = Eigen::VectorXd;
 
-  void process(RealMatrixView in, RealMatrixView out, index distance, index k)
+  void process(RealMatrixView in, RealMatrixView out, index distance, index k,
+               index numLandmarks = 0)
   {
     using namespace Eigen;
     using namespace _impl;
-    auto     dist = static_cast<DistanceFuncs::Distance>(distance);
     MatrixXd input = asEigen<Matrix>(in);
     index    n = input.rows();
-    MatrixXd D = MatrixXd::Zero(n, n);
-    MatrixXd I = MatrixXd::Identity(n, n);
-    MatrixXd ones = MatrixXd::Ones(n, n);
-    for (index i = 0; i < n; i++)
+    MatrixXd result;
+    if (numLandmarks <= 0 || numLandmarks >= n)
+    {
+      MatrixXd D = DistanceMatrix(input, distance);
+      doubleCentre(D);
+      mEigen.compute(D, k);
+      result = mEigen.eigenvectors() *
+               mEigen.eigenvalues().cwiseAbs().asDiagonal();
+    }
+    else
     {
-      for (index j = 0; j < n; j++)
-      { D(i, j) = DistanceFuncs::map()[dist](input.row(i), input.row(j)); }
+      assert(k <= numLandmarks);
+      selectLandmarks(input, distance, numLandmarks);
+      MatrixXd delta(numLandmarks, numLandmarks);
+      for (index i = 0; i < numLandmarks; i++)
+        delta.row(i) = mDistances.row(mLandmarks[asUnsigned(i)]);
+      VectorXd means = delta.rowwise().mean();
+      doubleCentre(delta);
+      mEigen.compute(delta, k);
+      // points are placed by -0.5 * (d - mean(d)) projected on the landmarks'
+      // eigenvectors over the square roots of their eigenvalues, which gives
+      // their classical coordinates. Classical MDS above scales those by the
+      // eigenvalues of all n points, i.e. by each component's sum of squares,
+      // so do the same with the placed points, centred like it
+      mDistances.rowwise() -= means.transpose();
+      VectorXd roots = mEigen.eigenvalues().cwiseAbs().cwiseSqrt().cwiseMax(
+          std::numeric_limits<double>::epsilon());
+      result = -0.5 * mDistances * mEigen.eigenvectors() *
+               roots.cwiseInverse().asDiagonal();
+      result.rowwise() -= result.colwise().mean();
+      VectorXd norms = result.colwise().norm().transpose();
+      result = result * norms.asDiagonal();
     }
-    MatrixXd J = I - ones / n;
-    D = -0.5 * J * D * J;
-    BDCSVD<MatrixXd> svd(D, ComputeThinV | ComputeThinU);
-    MatrixXd         U = svd.matrixU();
-    ArrayXd          s = svd.singularValues().segment(0, k);
-    MatrixXd         result =
-        U.block(0, 0, U.rows(), k).array().rowwise() * s.transpose();
     out = asFluid(result);
   }
+
+private:
+  // -0.5 * J * D * J with J = I - 1/n, without forming J
+  static void doubleCentre(MatrixXd& D)
+  {
+    VectorXd means = D.rowwise().mean();
+    double   mean = means.mean();
+    D.colwise() -= means;
+    D.rowwise() -= means.transpose();
+    D = -0.5 * (D.array() + mean).matrix();
+  }
+
+  // fills mDistances with the distances from every point to each landmark
+  void selectLandmarks(const MatrixXd& input, index distance, index m)
+  {
+    using namespace Eigen;
+    auto     dist = static_cast<DistanceFuncs::Distance>(distance);
+    index    n = input.rows();
+    MatrixXd points = input.transpose();
+    VectorXd nearest =
+        VectorXd::Constant(n, std::numeric_limits<double>::max());
+    mDistances.resize(n, m);
+    mLandmarks.resize(asUnsigned(m));
+    constexpr index chunkSize = 256;
+    index           next = 0;
+    for (index j = 0; j < m; j++)
+    {
+      mLandmarks[asUnsigned(j)] = next;
+      DistanceFuncs::dispatch(dist, [&](auto f) {
+        parallelFor((n + chunkSize - 1) / chunkSize, [&](index chunk) {
+          index end = std::min((chunk + 1) * chunkSize, n);
+          for (index i = chunk * chunkSize; i < end; i++)
+          {
+            mDistances(i, j) =
+                f(points.col(i).array(), points.col(next).array());
+          }
+        });
+      });
+      nearest = nearest.cwiseMin(mDistances.col(j));
+      nearest.maxCoeff(&next);
+    }
+  }
+
+  TruncatedEigen     mEigen;
+  MatrixXd           mDistances;
+  std::vector<index> mLandmarks;
 };
 }; // namespace algorithm
 }; // namespace fluid
@@ -13,11 +13,14 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../util/FluidEigenMappings.hpp"
 #include "../util/NNFuncs.hpp"
 #include "../util/NNLayer.hpp"
+#include "../util/ParallelFor.hpp"
+#include "../util/RandomGenerator.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
+#include <algorithm>
 #include <random>
 
 namespace fluid {
@@ -27,15 +30,34 @@ class MLP
 {
   using ArrayXd = Eigen::ArrayXd;
   using ArrayXXd = Eigen::ArrayXXd;
+  using MatrixXd = Eigen::MatrixXd;
+  using VectorXd = Eigen::VectorXd;
 
 public:
+  // Storage for training passes over up to a given number of examples: the
+  // output of each layer, the gradient of the loss with respect to it, and
+  // the parameter gradients and squared error summed over the examples. Each
+  // thread sharing a batch has its own
+  struct Workspace
+  {
+    std::vector<MatrixXd> outputs;
+    std::vector<MatrixXd> outputGrads;
+    std::vector<MatrixXd> weightsGrads;
+    std::vector<VectorXd> biasesGrads;
+    double                lossSum{0};
+  };
+
   explicit MLP() = default;
   ~MLP() = default;
 
+  /// A seed >= 0 makes the initial weights reproducible
   void init(index inputSize, index outputSize,
-            FluidTensor<index, 1> hiddenSizes, index hiddenAct, index outputAct)
+            FluidTensor<index, 1> hiddenSizes, index hiddenAct, index outputAct,
+            index seed = -1)
   {
     mLayers.clear();
+    mSeed = seed;
+    mRandomGenerator = makeGenerator(seed);
     std::vector<index> sizes = {inputSize};
     std::vector<index> activations = {};
     for (auto&& s : hiddenSizes)
@@ -50,7 +72,10 @@ public:
       mLayers.push_back(NNLayer(sizes[asUnsigned(i)], sizes[asUnsigned(i + 1)],
                                 activations[asUnsigned(i)]));
     }
-    for (auto&& l : mLayers) l.init();
+    for (auto&& l : mLayers) l.init(mRandomGenerator);
+    index widest = *std::max_element(sizes.begin(), sizes.end());
+    mFrameBuffer.resize(2 * widest);
+    mFrameBufferFloat.resize(2 * widest);
     mInitialized = true;
     mTrained = false;
   }
@@ -77,7 +102,8 @@ public:
 
   void clear()
   {
-    for (auto&& l : mLayers) l.init();
+    mRandomGenerator = makeGenerator(mSeed);
+    for (auto&& l : mLayers) l.init(mRandomGenerator);
     mInitialized = false;
     mTrained = false;
   }
@@ -88,77 +114,175 @@ public:
     return (pred - out).square().sum() / out.rows();
   }
 
+  // inference on many frames: tiles of rows are shared between numThreads
+  // threads (0 for all cores), and each goes through the layers by GEMM,
+  // between two buffers
+  void process(RealMatrixView in, RealMatrixView out, index startLayer,
+               index endLayer, index numThreads = 0)
+  {
+    index numTiles = (in.rows() + mTileSize - 1) / mTileSize;
+    ThreadPool pool(std::min(
+        numThreads > 0 ? numThreads : hardwareThreads(), numTiles));
+    process(in, out, startLayer, endLayer, pool);
+  }
+
+  // as above, on the threads of a pool kept by the caller
   void process(RealMatrixView in, RealMatrixView out, index startLayer,
-               index endLayer)
+               index endLayer, ThreadPool& pool)
   {
     using namespace _impl;
     using namespace Eigen;
-    ArrayXXd input = asEigen<Eigen::Array>(in);
-    ArrayXXd output = ArrayXXd::Zero(out.rows(), out.cols());
-    forward(input, output, startLayer, endLayer);
-    out = asFluid(output);
+    using RowMajorMatrixXd = Matrix<double, Dynamic, Dynamic, RowMajor>;
+    if (startLayer >= asSigned(mLayers.size()) ||
+        endLayer > asSigned(mLayers.size()))
+      return;
+    if (startLayer < 0 || endLayer <= 0 || startLayer >= endLayer) return;
+    auto  input = asEigen<Matrix>(in);
+    auto  output = asEigen<Matrix>(out);
+    index widest = mFrameBuffer.size() / 2;
+    index numTiles = (in.rows() + mTileSize - 1) / mTileSize;
+    pool.forEach(numTiles, [&](index tile) {
+      index            start = tile * mTileSize;
+      index            rows = std::min(mTileSize, in.rows() - start);
+      RowMajorMatrixXd a(rows, widest);
+      RowMajorMatrixXd b(rows, widest);
+      a.leftCols(in.cols()) = input.middleRows(start, rows);
+      index size = in.cols();
+      for (index i = startLayer; i < endLayer; i++)
+      {
+        auto& l = mLayers[asUnsigned(i)];
+        l.forwardBlock(a.leftCols(size), b.leftCols(l.outputSize()));
+        size = l.outputSize();
+        a.swap(b);
+      }
+      output.middleRows(start, rows) = a.leftCols(size);
+    });
   }
 
+  // processFrame doesn't allocate, so suits real-time use; the float version
+  // uses a single precision copy of the weights
   void processFrame(RealVectorView in, RealVectorView out, index startLayer,
                     index endLayer)
   {
-    using namespace _impl;
-    using namespace Eigen;
-    ArrayXd  tmpIn = asEigen<Eigen::Array>(in);
-    ArrayXXd input(1, tmpIn.size());
-    input.row(0) = tmpIn;
-    ArrayXXd output = ArrayXXd::Zero(1, out.size());
-    forward(input, output, startLayer, endLayer);
-    ArrayXd tmpOut = output.row(0);
-    out = asFluid(tmpOut);
+    processFrame(in, out, startLayer, endLayer, mFrameBuffer);
   }
 
-  void forward(Eigen::Ref<ArrayXXd> in, Eigen::Ref<ArrayXXd> out)
+  void processFrame(FluidTensorView<const float, 1> in,
+                    FluidTensorView<float, 1> out, index startLayer,
+                    index endLayer)
+  {
+    processFrame(in, out, startLayer, endLayer, mFrameBufferFloat);
+  }
+
+  void forward(Eigen::Ref<ArrayXXd> in, Eigen::Ref<ArrayXXd> out) const
   {
     forward(in, out, 0, asSigned(mLayers.size()));
   }
 
+  // with the current (training) weights, unlike process()
   void forward(Eigen::Ref<ArrayXXd> in, Eigen::Ref<ArrayXXd> out,
-               index startLayer, index endLayer)
+               index startLayer, index endLayer) const
   {
     if (startLayer >= asSigned(mLayers.size()) ||
         endLayer > asSigned(mLayers.size()))
       return;
     if (startLayer < 0 || endLayer <= 0) return;
-    ArrayXXd input = in;
-    ArrayXXd output;
+    MatrixXd input = in.matrix();
+    MatrixXd output;
     for (index i = startLayer; i < endLayer; i++)
     {
       auto&& l = mLayers[asUnsigned(i)];
-      output = ArrayXXd::Zero(input.rows(), l.outputSize());
+      output.resize(input.rows(), l.outputSize());
       l.forward(input, output);
-      input = output;
+      input.swap(output);
+    }
+    out = input.array();
+  }
+
+  void initWorkspace(Workspace& w, index maxRows) const
+  {
+    index nLayers = asSigned(mLayers.size());
+    w.outputs.resize(asUnsigned(nLayers));
+    w.outputGrads.resize(asUnsigned(nLayers));
+    w.weightsGrads.resize(asUnsigned(nLayers));
+    w.biasesGrads.resize(asUnsigned(nLayers));
+    for (index i = 0; i < nLayers; i++)
+    {
+      auto&& l = mLayers[asUnsigned(i)];
+      auto   u = asUnsigned(i);
+      w.outputs[u].resize(maxRows, l.outputSize());
+      w.outputGrads[u].resize(maxRows, l.outputSize());
+      w.weightsGrads[u].resize(l.inputSize(), l.outputSize());
+      w.biasesGrads[u].resize(l.outputSize());
+    }
+  }
+
+  // Adds the gradients of the squared error of the examples in the rows of
+  // in, against target, to those in w, and the error itself to w.lossSum.
+  // Doesn't allocate
+  void accumulateGradients(Eigen::Ref<const MatrixXd> in,
+                           Eigen::Ref<const MatrixXd> target,
+                           Workspace&                 w) const
+  {
+    using Input = Eigen::Ref<const MatrixXd>;
+    index rows = in.rows();
+    index nLayers = asSigned(mLayers.size());
+    auto  layerInput = [&](index i) {
+      return i == 0 ? in : Input(w.outputs[asUnsigned(i - 1)].topRows(rows));
+    };
+    for (index i = 0; i < nLayers; i++)
+    {
+      auto u = asUnsigned(i);
+      mLayers[u].forward(layerInput(i), w.outputs[u].topRows(rows));
+    }
+    auto last = asUnsigned(nLayers - 1);
+    w.outputGrads[last].topRows(rows) = w.outputs[last].topRows(rows) - target;
+    w.lossSum += w.outputGrads[last].topRows(rows).squaredNorm();
+    for (index i = nLayers - 1; i >= 0; i--)
+    {
+      auto u = asUnsigned(i);
+      mLayers[u].backward(layerInput(i), w.outputs[u].topRows(rows),
+                          w.outputGrads[u].topRows(rows), w.weightsGrads[u],
+                          w.biasesGrads[u]);
+      if (i > 0)
+        mLayers[u].backwardInput(w.outputGrads[u].topRows(rows),
+                                 w.outputGrads[u - 1].topRows(rows));
     }
-    out = output;
   }
 
-  void backward(Eigen::Ref<ArrayXXd> out)
+  static void clearGradients(Workspace& w)
   {
-    index    nRows = out.rows();
-    ArrayXXd chain =
-        ArrayXXd::Zero(nRows, mLayers[mLayers.size() - 1].inputSize());
-    mLayers[mLayers.size() - 1].backward(out, chain);
-    for (index i = asSigned(mLayers.size() - 2); i >= 0; i--)
+    for (auto& g : w.weightsGrads) g.setZero();
+    for (auto& g : w.biasesGrads) g.setZero();
+    w.lossSum = 0;
+  }
+
+  // the gradients summed in w, scaled, become those for update()
+  void setGradients(const Workspace& w, double scale)
+  {
+    for (index i = 0; i < asSigned(mLayers.size()); i++)
     {
-      ArrayXXd tmp = ArrayXXd::Zero(nRows, mLayers[asUnsigned(i)].inputSize());
-      mLayers[asUnsigned(i)].backward(chain, tmp);
-      chain = tmp;
+      auto u = asUnsigned(i);
+      mLayers[u].setGradients(w.weightsGrads[u], w.biasesGrads[u], scale);
     }
   }
 
-  void update(double learningRate, double momentum)
+  void update(double learningRate, double momentum,
+              index optimizer = NNLayer::kSGD)
   {
-    for (auto&& l : mLayers) l.update(learningRate, momentum);
+    for (auto&& l : mLayers) l.update(learningRate, momentum, optimizer);
   }
 
   index size() const { return asSigned(mLayers.size()); }
   bool  trained() const { return mTrained; }
-  void  setTrained(bool val) { mTrained = val; }
+
+  // training leaves processFrame's copies of the weights behind
+  void setTrained(bool val)
+  {
+    mTrained = val;
+    if (val)
+      for (auto&& l : mLayers) l.prepareInference();
+  }
   index initialized() const { return mInitialized; }
 
   // 0 = size of the input, 1 = output size of first hidden
@@ -192,6 +316,35 @@ public:
   std::vector<NNLayer> mLayers;
   bool                 mInitialized{false};
   bool                 mTrained{false};
+  index                mSeed{-1};
+  std::mt19937         mRandomGenerator;
+
+private:
+  // layers ping-pong between the two halves of buffer
+  template <typename In, typename Out, typename Buffer>
+  void processFrame(In in, Out out, index startLayer, index endLayer,
+                    Buffer& buffer)
+  {
+    using T = typename Buffer::Scalar;
+    if (startLayer >= asSigned(mLayers.size()) ||
+        endLayer > asSigned(mLayers.size()))
+      return;
+    if (startLayer < 0 || endLayer <= 0 || startLayer >= endLayer) return;
+    index half = buffer.size() / 2;
+    T*    input = buffer.data();
+    T*    output = buffer.data() + half;
+    for (index i = 0; i < in.size(); i++) input[i] = in(i);
+    for (index i = startLayer; i < endLayer; i++)
+    {
+      mLayers[asUnsigned(i)].forwardFrame(input, output);
+      std::swap(input, output);
+    }
+    for (index i = 0; i < out.size(); i++) out(i) = input[i];
+  }
+
+  Eigen::VectorXd mFrameBuffer;
+  Eigen::VectorXf mFrameBufferFloat;
+  index           mTileSize{256};
 };
 } // namespace algorithm
 } // namespace fluid
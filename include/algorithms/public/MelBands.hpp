@@ -16,6 +16,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include <Eigen/Core>
 #include <cassert>
 #include <cmath>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -24,8 +25,11 @@ class MelBands
 {
 public:
   MelBands(index maxBands, index maxFFT)
-      : mFiltersStorage(maxBands, maxFFT / 2 + 1)
-  {}
+      : mFilters(maxBands, maxFFT / 2 + 1)
+  {
+    mBandStart.reserve(asUnsigned(maxBands));
+    mBandSize.reserve(asUnsigned(maxBands));
+  }
 
   /*static inline double mel2hz(double x) {
       return 700.0 * (exp(x / 1127.01048) - 1.0);
@@ -48,20 +52,30 @@ public:
     mScale2 = 1.0 / (2.0 * double(fftSize) / windowSize);
     ArrayXd melFreqs = ArrayXd::LinSpaced(nBands + 2, hz2mel(lo), hz2mel(hi));
     melFreqs = 700.0 * ((melFreqs / 1127.01048).exp() - 1.0);
-    mFilters = mFiltersStorage.block(0, 0, nBands, nBins);
-    mFilters.setZero();
     ArrayXd fftFreqs = ArrayXd::LinSpaced(nBins, 0, sampleRate / 2.0);
     ArrayXd melD =
         (melFreqs.segment(0, nBands + 1) - melFreqs.segment(1, nBands + 1))
             .abs();
     ArrayXXd ramps = melFreqs.replicate(1, nBins);
     ramps.rowwise() -= fftFreqs.transpose();
+    mBandStart.resize(asUnsigned(nBands));
+    mBandSize.resize(asUnsigned(nBands));
     for (index i = 0; i < nBands; i++)
     {
       ArrayXd lower = -ramps.row(i) / melD(i);
       ArrayXd upper = ramps.row(i + 2) / melD(i + 1);
-      mFilters.row(i) = lower.min(upper).max(0);
+      ArrayXd filter = lower.min(upper).max(0);
+      // each triangle only covers a few bins: keep its extent so that
+      // processFrame only touches the non-zero part of the row
+      index start = 0, end = nBins;
+      while (start < nBins && filter(start) == 0) start++;
+      while (end > start && filter(end - 1) == 0) end--;
+      mBandStart[asUnsigned(i)] = start;
+      mBandSize[asUnsigned(i)] = end - start;
+      mFilters.row(i).segment(start, end - start) =
+          filter.segment(start, end - start).transpose();
     }
+    mNBands = nBands;
   }
 
   void processFrame(const RealVectorView in, RealVectorView out, bool magNorm,
@@ -71,11 +85,16 @@ public:
 
     ArrayXd frame = _impl::asEigen<Eigen::Array>(in);
     if (magNorm) frame = frame * mScale1;
-    ArrayXd result;
-    if (usePower) { result = (mFilters * frame.square().matrix()).array(); }
-    else
+    ArrayXd weighted = frame;
+    if (usePower) weighted = weighted.square();
+    ArrayXd result(mNBands);
+    for (index i = 0; i < mNBands; i++)
     {
-      result = (mFilters * frame.matrix()).array();
+      index start = mBandStart[asUnsigned(i)];
+      index size = mBandSize[asUnsigned(i)];
+      result(i) = mFilters.row(i)
+                      .segment(start, size)
+                      .dot(weighted.matrix().segment(start, size).transpose());
     }
     if (magNorm)
     {
@@ -90,8 +109,12 @@ public:
   double mScale1{1.0};
   double mScale2{1.0};
 
-  Eigen::MatrixXd mFilters;
-  Eigen::MatrixXd mFiltersStorage;
+  // Filters are stored row-major, as per-band spans [start, start + size)
+  index                                                 mNBands{0};
+  std::vector<index>                                    mBandStart;
+  std::vector<index>                                    mBandSize;
+  Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      mFilters;
 };
 } // namespace algorithm
 } // namespace fluid
@@ -12,9 +12,11 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "../util/AlgorithmUtils.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/RandomGenerator.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
+#include <random>
 #include <vector>
 
 namespace fluid {
@@ -28,6 +30,9 @@ public:
   // cancelled)
   using ProgressCallback = std::function<bool(index)>;
 
+  /// A seed >= 0 makes the random initialisations reproducible
+  explicit NMF(index seed = -1) : mRandomGenerator(makeGenerator(seed)) {}
+
   static void estimate(const RealMatrixView W, const RealMatrixView H,
                        index idx, RealMatrixView V)
   {
@@ -49,8 +54,8 @@ public:
     using namespace _impl;
     index    rank = W0.extent(0);
     MatrixXd W = asEigen<Matrix>(W0).transpose();
-    VectorXd h =
-        MatrixXd::Random(rank, 1) * 0.5 + MatrixXd::Constant(rank, 1, 0.5);
+    VectorXd h = uniformRandom<MatrixXd>(rank, 1, mRandomGenerator) * 0.5 +
+                 MatrixXd::Constant(rank, 1, 0.5);
     VectorXd v0 = asEigen<Matrix>(x);
     W = W.array().max(epsilon).matrix();
     h = h.array().max(epsilon).matrix();
@@ -90,7 +95,7 @@ public:
     MatrixXd W;
     if (W0.extent(0) == 0 && W0.extent(1) == 0)
     {
-      W = MatrixXd::Random(nBins, rank) * 0.5 +
+      W = uniformRandom<MatrixXd>(nBins, rank, mRandomGenerator) * 0.5 +
           MatrixXd::Constant(nBins, rank, 0.5);
     }
     else
@@ -102,7 +107,7 @@ public:
     MatrixXd H;
     if (H0.extent(0) == 0 && H0.extent(1) == 0)
     {
-      H = MatrixXd::Random(rank, nFrames) * 0.5 +
+      H = uniformRandom<MatrixXd>(rank, nFrames, mRandomGenerator) * 0.5 +
           MatrixXd::Constant(rank, nFrames, 0.5);
     }
     else
@@ -172,6 +177,7 @@ private:
   }
 
   std::vector<ProgressCallback> mCallbacks;
+  std::mt19937                  mRandomGenerator;
 };
 } // namespace algorithm
 } // namespace fluid
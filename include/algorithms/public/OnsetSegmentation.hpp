@@ -19,6 +19,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Eigen>
 #include <algorithm>
+#include <array>
 #include <cassert>
 
 namespace fluid {
@@ -31,13 +32,16 @@ public:
   using ArrayXd = Eigen::ArrayXd;
   using ArrayXcd = Eigen::ArrayXcd;
 
-  OnsetSegmentation(index maxSize) : mFFT(maxSize), mWindowStorage(maxSize) {}
+  OnsetSegmentation(index maxSize)
+      : mFFT(maxSize), mWindowStorage(maxSize), mWindowedFrame(maxSize)
+  {}
 
   void init(index windowSize, index fftSize, index filterSize)
   {
     makeWindow(windowSize);
-    prevFrame = ArrayXcd::Zero(fftSize / 2 + 1);
-    prevPrevFrame = ArrayXcd::Zero(fftSize / 2 + 1);
+    for (auto& s : mSpectra) s.setZero(fftSize / 2 + 1);
+    mDeltaSpectrum.setZero(fftSize / 2 + 1);
+    mCurrent = 0;
     mFilter.init(filterSize);
     mFFT.resize(fftSize);
     mDebounceCount = 1;
@@ -58,35 +62,49 @@ public:
                       index frameDelta = 0)
   {
     assert(mInitialized);
-    ArrayXd in = _impl::asEigen<Eigen::Array>(input);
-    double  funcVal = 0;
-    double  filteredFuncVal = 0;
-    double  detected = 0.;
+    auto   in = _impl::asEigen<Eigen::Array>(input).col(0);
+    double funcVal = 0;
+    double filteredFuncVal = 0;
+    double detected = 0.;
     if (filterSize >= 3 &&
         (!mFilter.initialized() || filterSize != mFilter.size()))
       mFilter.init(filterSize);
 
-    ArrayXcd frame = mFFT.process(in.segment(0, mWindowSize) * mWindow);
-    auto     odf = static_cast<OnsetDetectionFuncs::ODF>(function);
+    if (!mODF || function != mFunction)
+    {
+      auto odf = static_cast<OnsetDetectionFuncs::ODF>(function);
+      mODF = OnsetDetectionFuncs::select(odf);
+      // the previous frames may have been kept without their phase
+      if (OnsetDetectionFuncs::needsPhase(odf) && !mNeedsPhase)
+        for (auto& s : mSpectra) s.set(s.frame);
+      mNeedsPhase = OnsetDetectionFuncs::needsPhase(odf);
+      mFunction = function;
+    }
+
+    // The spectra are a ring: the oldest one is replaced by the current frame
+    mCurrent = (mCurrent + 1) % 3;
+    auto& frame = mSpectra[asUnsigned(mCurrent)];
+    auto& prevFrame = mSpectra[asUnsigned((mCurrent + 2) % 3)];
+    auto& prevPrevFrame = mSpectra[asUnsigned((mCurrent + 1) % 3)];
+
+    frame.set(mFFT.process(windowed(in.segment(0, mWindowSize))),
+              mNeedsPhase);
     if (function > 1 && function < 5 && frameDelta != 0)
     {
-      ArrayXcd frame2 =
-          mFFT.process(in.segment(frameDelta, mWindowSize) * mWindow);
-      funcVal = OnsetDetectionFuncs::map()[odf](frame2, frame, frame);
+      mDeltaSpectrum.set(
+          mFFT.process(windowed(in.segment(frameDelta, mWindowSize))),
+          mNeedsPhase);
+      funcVal = mODF(mDeltaSpectrum, frame, frame);
     }
     else
     {
-      funcVal =
-          OnsetDetectionFuncs::map()[odf](frame, prevFrame, prevPrevFrame);
+      funcVal = mODF(frame, prevFrame, prevPrevFrame);
     }
     if (filterSize >= 3)
       filteredFuncVal = funcVal - mFilter.processSample(funcVal);
     else
       filteredFuncVal = funcVal - mPrevFuncVal;
 
-    prevPrevFrame = prevFrame;
-    prevFrame = frame;
-
     if (filteredFuncVal > threshold && mPrevFuncVal < threshold &&
         mDebounceCount == 0)
     {
@@ -102,18 +120,31 @@ public:
   }
 
 private:
+  template <typename Derived>
+  Eigen::Ref<const ArrayXd> windowed(const Eigen::ArrayBase<Derived>& frame)
+  {
+    mWindowedFrame.head(mWindowSize) = frame * mWindow;
+    return mWindowedFrame.head(mWindowSize);
+  }
+
   using WindowTypes = WindowFuncs::WindowTypes;
-  FFT          mFFT{1024};
-  ArrayXd      mWindowStorage;
-  ArrayXd      mWindow;
-  index        mWindowSize{1024};
-  index        mDebounceCount{1};
-  ArrayXcd     prevFrame;
-  ArrayXcd     prevPrevFrame;
-  double       mPrevFuncVal{0.0};
-  WindowTypes  mWindowType{WindowTypes::kHann};
-  MedianFilter mFilter;
-  bool         mInitialized{false};
+  using Spectrum = OnsetDetectionFuncs::Spectrum;
+  FFT                              mFFT{1024};
+  ArrayXd                          mWindowStorage;
+  ArrayXd                          mWindow;
+  index                            mWindowSize{1024};
+  index                            mDebounceCount{1};
+  ArrayXd                          mWindowedFrame;
+  std::array<Spectrum, 3>          mSpectra;
+  Spectrum                         mDeltaSpectrum;
+  index                            mCurrent{0};
+  OnsetDetectionFuncs::ODFFunction mODF{nullptr};
+  index                            mFunction{-1};
+  bool                             mNeedsPhase{false};
+  double                           mPrevFuncVal{0.0};
+  WindowTypes                      mWindowType{WindowTypes::kHann};
+  MedianFilter                     mFilter;
+  bool                             mInitialized{false};
 };
 
 } // namespace algorithm
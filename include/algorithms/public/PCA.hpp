@@ -11,9 +11,11 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/TruncatedSVD.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
 #include <Eigen/SVD>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -30,23 +32,92 @@ public:
   {
     using namespace Eigen;
     using namespace _impl;
-    MatrixXd input = asEigen<Matrix>(in);
+    auto input = asEigen<Matrix>(in);
     mMean = input.colwise().mean();
     MatrixXd         X = (input.rowwise() - mMean.transpose());
-    BDCSVD<MatrixXd> svd(X.matrix(), ComputeThinV | ComputeThinU);
+    BDCSVD<MatrixXd> svd(X, ComputeThinV);
     mBases = svd.matrixV();
     mValues = svd.singularValues();
+    mNumPoints = in.rows();
     mInitialized = true;
   }
 
-  void init(RealMatrixView bases, RealVectorView values, RealVectorView mean)
+  // Only the first k bases, by randomized SVD: the data is neither copied
+  // nor fully decomposed. Without the rest of the spectrum, such a model
+  // cannot tell what fraction of the variance its bases account for
+  void init(RealMatrixView in, index k)
+  {
+    // rows with unit stride let Eigen use its fast matrix products
+    if (in.descriptor().strides[1] == 1)
+    {
+      using RowMatrixXd =
+          Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+      Eigen::Map<const RowMatrixXd, 0, Eigen::OuterStride<>> input(
+          in.data(), in.rows(), in.cols(),
+          Eigen::OuterStride<>(in.descriptor().strides[0]));
+      initTruncated(input, k);
+    }
+    else
+      initTruncated(_impl::asEigen<Eigen::Matrix>(in), k);
+  }
+
+  void init(RealMatrixView bases, RealVectorView values, RealVectorView mean,
+            index numPoints = 0)
   {
     mBases = _impl::asEigen<Eigen::Matrix>(bases);
     mValues = _impl::asEigen<Eigen::Matrix>(values);
     mMean = _impl::asEigen<Eigen::Matrix>(mean);
+    mNumPoints = numPoints;
     mInitialized = true;
   }
 
+  // Incremental PCA (Ross et al., 2008): the current bases, scaled by their
+  // singular values, stand in for the points seen so far, and are decomposed
+  // again together with the new (centred) points and a row that accounts for
+  // the shift of the mean. Keeping every basis (k <= 0) gives the same model
+  // as fitting all the points at once; keeping k gives an approximation that
+  // only costs time and memory in proportion to k and the new points
+  void update(RealMatrixView in, index k = 0)
+  {
+    using namespace Eigen;
+    using namespace _impl;
+    assert(!mInitialized || (mNumPoints > 0 && in.cols() == dims()));
+    if (!mInitialized)
+    {
+      if (k > 0)
+        init(in, k);
+      else
+        init(in);
+      return;
+    }
+    auto     input = asEigen<Matrix>(in);
+    index    r = mBases.cols();
+    double   n = static_cast<double>(mNumPoints);
+    double   m = static_cast<double>(in.rows());
+    VectorXd batchMean = input.colwise().mean();
+    MatrixXd stacked(r + in.rows() + 1, dims());
+    stacked.topRows(r) = mValues.asDiagonal() * mBases.transpose();
+    stacked.middleRows(r, in.rows()) = input.rowwise() - batchMean.transpose();
+    stacked.bottomRows(1) =
+        std::sqrt(n * m / (n + m)) * (batchMean - mMean).transpose();
+    index rank = std::min(stacked.rows(), dims());
+    if (k > 0 && k < rank)
+    {
+      TruncatedSVD svd;
+      svd.compute(stacked, VectorXd::Zero(dims()), k);
+      mBases = svd.matrixV();
+      mValues = svd.singularValues();
+    }
+    else
+    {
+      BDCSVD<MatrixXd> svd(stacked, ComputeThinV);
+      mBases = svd.matrixV();
+      mValues = svd.singularValues();
+    }
+    mMean = (n * mMean + m * batchMean) / (n + m);
+    mNumPoints += in.rows();
+  }
+
   void processFrame(const RealVectorView in, RealVectorView out, index k) const
   {
     using namespace Eigen;
@@ -58,37 +129,61 @@ public:
     out = _impl::asFluid(result);
   }
 
+  // Returns the fraction of the sum of singular values that the k bases
+  // account for, or -1 for a truncated model, which does not know the sum
   double process(const RealMatrixView in, RealMatrixView out, index k) const
   {
     using namespace Eigen;
     using namespace _impl;
     if (k > mBases.cols()) return 0;
-    MatrixXd input = asEigen<Matrix>(in);
-    MatrixXd result = (input.rowwise() - mMean.transpose()) *
+    MatrixXd result = (asEigen<Matrix>(in).rowwise() - mMean.transpose()) *
                       mBases.block(0, 0, mBases.rows(), k);
+    out = _impl::asFluid(result);
+    if (truncated()) return -1;
     double variance = 0;
     double total = mValues.sum();
     for (index i = 0; i < k; i++) variance += mValues[i];
-    out = _impl::asFluid(result);
     return variance / total;
   }
 
+  template <typename Derived>
+  void initTruncated(const Eigen::MatrixBase<Derived>& input, index k)
+  {
+    mMean = input.colwise().mean();
+    TruncatedSVD svd;
+    svd.compute(input, mMean, std::min({k, input.rows(), input.cols()}));
+    mBases = svd.matrixV();
+    mValues = svd.singularValues();
+    mNumPoints = input.rows();
+    mInitialized = true;
+  }
+
   bool  initialized() const { return mInitialized; }
   void  getBases(RealMatrixView out) const { out = _impl::asFluid(mBases); }
   void  getValues(RealVectorView out) const { out = _impl::asFluid(mValues); }
   void  getMean(RealVectorView out) const { out = _impl::asFluid(mMean); }
   index dims() const { return mBases.rows(); }
   index size() const { return mBases.cols(); }
+  index numPoints() const { return mNumPoints; }
+
+  // a full fit keeps min(points, dimensions) bases; models loaded without a
+  // point count are taken to be full
+  bool truncated() const
+  {
+    return mNumPoints > 0 && size() < std::min(mNumPoints, dims());
+  }
   void  clear()
   {
     mBases.setZero();
     mMean.setZero();
+    mNumPoints = 0;
     mInitialized = false;
   }
 
   MatrixXd mBases;
   VectorXd mValues;
   VectorXd mMean;
+  index    mNumPoints{0};
   bool     mInitialized{false};
 };
 }; // namespace algorithm
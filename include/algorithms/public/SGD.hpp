@@ -12,13 +12,21 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "MLP.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/ParallelFor.hpp"
+#include "../util/RandomGenerator.hpp"
 #include "../../data/FluidDataSet.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <limits>
+#include <numeric>
 #include <random>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -27,95 +35,181 @@ class SGD
 {
   using ArrayXd = Eigen::ArrayXd;
   using ArrayXXd = Eigen::ArrayXXd;
-  using Permutation = Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic>;
+  using MatrixXd = Eigen::MatrixXd;
 
 public:
-  explicit SGD() = default;
+  // What a progress callback sees after each epoch: the mean squared error of
+  // the training examples (summed over the epoch's batches, so as the model
+  // was before each update), that of the validation set, or -1 without one,
+  // and the epoch's wall time and throughput
+  struct Progress
+  {
+    index  epoch;
+    index  maxEpochs;
+    double loss;
+    double validationLoss;
+    double seconds;
+    double totalSeconds;
+    double examplesPerSecond;
+  };
+
+  // returning false stops training, which keeps the weights reached so far
+  using ProgressCallback = std::function<bool(const Progress&)>;
+
+  /// Training stops once the validation loss has failed to improve for
+  /// patience epochs in a row
+  explicit SGD(index patience = 10) : mPatience(std::max<index>(patience, 1))
+  {}
   ~SGD() = default;
 
+  void addProgressCallback(ProgressCallback&& callback)
+  {
+    mCallbacks.emplace_back(std::move(callback));
+  }
+
+  // Batches are gathered by index into reused buffers, from a shuffled list
+  // of the training rows, rather than by permuting the data every epoch.
+  // Large enough batches are split into shards, which sum gradients into
+  // their own workspaces before a single update. The number of shards depends
+  // only on the batch size, so a seeded run gives the same weights however
+  // many threads (numThreads = 0 for all cores) share them; the threads are
+  // started once, and kept for every batch. An epoch whose
+  // loss is not finite ends training, as the weights will not recover
   double train(MLP& model, const RealMatrixView in, RealMatrixView out,
                index nIter, index batchSize, double learningRate,
-               double momentum, double valFrac)
+               double momentum, double valFrac, index seed = -1,
+               index optimizer = NNLayer::kSGD, index numThreads = 0)
   {
     using namespace _impl;
     using namespace std;
     using namespace Eigen;
-    index       nExamples = in.rows();
-    index       inputSize = in.cols();
-    index       outputSize = out.cols();
-    ArrayXXd    input = asEigen<Eigen::Array>(in);
-    ArrayXXd    output = asEigen<Eigen::Array>(out);
-    Permutation valPerm(nExamples);
-    valPerm.setIdentity();
-    shuffle(valPerm.indices().data(),
-            valPerm.indices().data() + valPerm.indices().size(),
-            mt19937{random_device{}()});
-    input = valPerm * input.matrix();
-    output = valPerm * output.matrix();
+    index              nExamples = in.rows();
+    index              inputSize = in.cols();
+    index              outputSize = out.cols();
+    auto               input = asEigen<Eigen::Array>(in);
+    auto               output = asEigen<Eigen::Array>(out);
+    mt19937            gen = makeGenerator(seed);
+    std::vector<index> order(asUnsigned(nExamples));
+    iota(order.begin(), order.end(), 0);
+    shuffle(order.begin(), order.end(), gen);
     index nVal = std::lround(nExamples * valFrac);
     index nTrain = nExamples - nVal;
+    auto  trainEnd = order.begin() + nTrain;
 
-    ArrayXXd trainInput = input.block(0, 0, nTrain, inputSize);
-    ArrayXXd trainOutput = output.block(0, 0, nTrain, outputSize);
-    ArrayXXd valInput = input.block(nTrain, 0, nVal, inputSize);
-    ArrayXXd valOutput = output.block(nTrain, 0, nVal, outputSize);
+    ArrayXXd valInput(nVal, inputSize);
+    ArrayXXd valOutput(nVal, outputSize);
+    gather(input, order.begin() + nTrain, order.end(), valInput);
+    gather(output, order.begin() + nTrain, order.end(), valOutput);
 
-    Permutation iterPerm(nTrain);
-    iterPerm.setIdentity();
+    batchSize = std::max<index>(std::min(batchSize, nTrain), 1);
+    MatrixXd batchIn(batchSize, inputSize);
+    MatrixXd batchOut(batchSize, outputSize);
+    index    numShards = std::max<index>(
+        std::min(mMaxShards, batchSize / mMinShardSize), 1);
+    index shardSize = (batchSize + numShards - 1) / numShards;
+    std::vector<MLP::Workspace> workspaces(asUnsigned(numShards));
+    for (auto& w : workspaces) model.initWorkspace(w, shardSize);
+    ThreadPool pool(std::min(
+        numThreads > 0 ? numThreads : hardwareThreads(), numShards));
+
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
     double error = 0;
-    index  patience = mInitialPatience;
+    index  patience = mPatience;
     double prevValLoss = std::numeric_limits<double>::max();
-    while (nIter-- > 0)
+    auto   trainStart = clock::now();
+    for (index epoch = 1; epoch <= nIter; epoch++)
     {
-      shuffle(iterPerm.indices().data(),
-              iterPerm.indices().data() + iterPerm.indices().size(),
-              mt19937{random_device{}()});
-      ArrayXXd inPerm = iterPerm * trainInput.matrix();
-      ArrayXXd outPerm = iterPerm * trainOutput.matrix();
-      for (index batchStart = 0; batchStart < inPerm.rows();
-           batchStart += batchSize)
+      auto   epochStart = clock::now();
+      double lossSum = 0;
+      shuffle(order.begin(), trainEnd, gen);
+      for (index batchStart = 0; batchStart < nTrain; batchStart += batchSize)
       {
-        index thisBatchSize = (batchStart + batchSize) <= nTrain
-                                  ? batchSize
-                                  : nTrain - batchStart;
-        ArrayXXd batchIn =
-            inPerm.block(batchStart, 0, thisBatchSize, inPerm.cols());
-        ArrayXXd batchOut =
-            outPerm.block(batchStart, 0, thisBatchSize, outPerm.cols());
-        ArrayXXd batchPred = ArrayXXd::Zero(thisBatchSize, outputSize);
-        model.forward(batchIn, batchPred);
-        ArrayXXd diff = batchPred - batchOut;
-        model.backward(diff);
-        model.update(learningRate, momentum);
+        index thisBatchSize = std::min(batchSize, nTrain - batchStart);
+        auto  batchBegin = order.begin() + batchStart;
+        auto  thisIn = batchIn.topRows(thisBatchSize);
+        auto  thisOut = batchOut.topRows(thisBatchSize);
+        gather(input, batchBegin, batchBegin + thisBatchSize, thisIn);
+        gather(output, batchBegin, batchBegin + thisBatchSize, thisOut);
+        pool.forEach(numShards, [&](index shard) {
+          auto& w = workspaces[asUnsigned(shard)];
+          MLP::clearGradients(w);
+          index start = std::min(shard * shardSize, thisBatchSize);
+          index rows = std::min(shardSize, thisBatchSize - start);
+          if (rows > 0)
+            model.accumulateGradients(thisIn.middleRows(start, rows),
+                                      thisOut.middleRows(start, rows), w);
+        });
+        for (index shard = 1; shard < numShards; shard++)
+          sumGradients(workspaces[asUnsigned(shard)], workspaces[0]);
+        lossSum += workspaces[0].lossSum;
+        model.setGradients(workspaces[0], 1.0 / thisBatchSize);
+        model.update(learningRate, momentum, optimizer);
       }
-      if (nVal > 0)
+      double trainLoss = lossSum / nTrain;
+      bool   diverged = !std::isfinite(trainLoss);
+      double valLoss = -1;
+      if (nVal > 0 && !diverged)
       {
         ArrayXXd valPred = ArrayXXd::Zero(nVal, outputSize);
         model.forward(valInput, valPred);
-        double valLoss = model.loss(valPred, valOutput);
+        valLoss = model.loss(valPred, valOutput);
         if (valLoss < prevValLoss)
-          patience = mInitialPatience;
+          patience = mPatience;
         else
           patience--;
-        if (patience <= 0) break;
         prevValLoss = valLoss;
       }
+      auto   now = clock::now();
+      double epochSeconds = seconds(now - epochStart).count();
+      Progress progress{epoch,
+                        nIter,
+                        trainLoss,
+                        valLoss,
+                        epochSeconds,
+                        seconds(now - trainStart).count(),
+                        epochSeconds > 0 ? nTrain / epochSeconds : 0};
+      bool     carryOn = true;
+      for (auto& cb : mCallbacks) carryOn = cb(progress) && carryOn;
+      if (!carryOn || diverged || patience <= 0) break;
     }
+    ArrayXXd finalInput = input;
+    ArrayXXd finalOutput = output;
     ArrayXXd finalPred = ArrayXXd::Zero(nExamples, outputSize);
-    model.forward(input, finalPred);
+    model.forward(finalInput, finalPred);
     bool isNan = !((finalPred == finalPred)).all();
     if (isNan)
     {
       model.clear();
       return -1;
     }
-    error = model.loss(finalPred, output);
+    error = model.loss(finalPred, finalOutput);
     model.setTrained(true);
     return error;
   }
 
 private:
-  index mInitialPatience{10};
+  static void sumGradients(const MLP::Workspace& from, MLP::Workspace& to)
+  {
+    for (size_t i = 0; i < to.weightsGrads.size(); i++)
+    {
+      to.weightsGrads[i] += from.weightsGrads[i];
+      to.biasesGrads[i] += from.biasesGrads[i];
+    }
+    to.lossSum += from.lossSum;
+  }
+
+  template <typename Data, typename Iterator, typename Out>
+  static void gather(const Data& data, Iterator begin, Iterator end, Out& out)
+  {
+    index row = 0;
+    for (auto i = begin; i != end; ++i) out.row(row++) = data.row(*i);
+  }
+
+  index                         mPatience{10};
+  index                         mMinShardSize{32};
+  index                         mMaxShards{16};
+  std::vector<ProgressCallback> mCallbacks;
 };
 } // namespace algorithm
 } // namespace fluid
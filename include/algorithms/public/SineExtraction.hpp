@@ -21,7 +21,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
 #include <cmath>
-#include <queue>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -32,6 +32,7 @@ class SineExtraction
   using ArrayXd = Eigen::ArrayXd;
   using VectorXd = Eigen::VectorXd;
   using ArrayXcd = Eigen::ArrayXcd;
+  using ArrayXXcd = Eigen::ArrayXXcd;
   template <typename T>
   using vector = std::vector<T>;
 
@@ -40,12 +41,15 @@ public:
   {
     mBins = fftSize / 2 + 1;
     mCurrentFrame = 0;
-    mBuf = std::queue<ArrayXcd>();
     mScale = 1.0 / (windowSize / 4.0); // scale to original amplitude
     computeWindowTransform(windowSize, transformSize);
     mTracking.init();
     mWindowBinIncr = mWindowTransform.size() / (mBins - 1) / 2;
     mInvWindowBinIncr = 1.0 / mWindowBinIncr;
+    mMag.resize(mBins);
+    mLogMag.resize(mBins);
+    mFrameSines.resize(mBins);
+    resetBuffer(mTracking.minTrackLength());
     mInitialized = true;
   }
 
@@ -57,60 +61,57 @@ public:
   {
     assert(mInitialized);
     using namespace Eigen;
-    index    fftSize = 2 * (mBins - 1);
-    ArrayXcd frame = _impl::asEigen<Array>(in);
+    index fftSize = 2 * (mBins - 1);
+    auto  frame = _impl::asEigen<Array>(in).col(0);
+    auto  result = _impl::asEigen<Array>(out);
     if (minTrackLength != mTracking.minTrackLength())
-    { mBuf = std::queue<ArrayXcd>(); }
-    mBuf.push(frame);
-    ArrayXd mag = frame.abs().real();
-    mag = mag * mScale;
-    ArrayXd          logMag = 20 * mag.max(epsilon).log10();
-    vector<SinePeak> peaks;
-    auto tmpPeaks = mPeakDetection.process(logMag, 0, -infinity, true, false);
-    for (auto p : tmpPeaks)
+      resetBuffer(minTrackLength);
+    mBuf.col((mBufHead + mBufCount) % mBuf.cols()) = frame;
+    mBufCount++;
+    mMag = frame.abs().real();
+    mMag = mMag * mScale;
+    mLogMag = 20 * mMag.max(epsilon).log10();
+    mPeaks.clear();
+    auto tmpPeaks = mPeakDetection.process(mLogMag, 0, -infinity, true, false);
+    for (auto& p : tmpPeaks)
     {
       if (p.second > detectionThreshold)
       {
         double hz = sampleRate * p.first / fftSize;
-        peaks.push_back({hz, p.second, false});
+        mPeaks.push_back({hz, p.second, false});
       }
     }
-    double maxAmp = 20 * std::log10(mag.maxCoeff());
-    mTracking.processFrame(peaks, maxAmp, minTrackLength, birthLowThreshold,
+    double maxAmp = 20 * std::log10(mMag.maxCoeff());
+    mTracking.processFrame(mPeaks, maxAmp, minTrackLength, birthLowThreshold,
                            birthHighThreshold, trackMethod, zetaA, zetaF,
                            delta);
-    vector<SinePeak> sinePeaks = mTracking.getActivePeaks();
-    ArrayXd          frameSines = ArrayXd::Zero(mBins);
-    for (auto& p : sinePeaks)
-    { frameSines += synthesizePeak(p, sampleRate, bandwidth); }
-    ArrayXXcd result(mBins, 2);
-    if (asSigned(mBuf.size()) <= mTracking.minTrackLength())
-    {
-      result.col(0) = ArrayXd::Zero(mBins);
-      result.col(1) = ArrayXd::Zero(mBins);
-    }
+    mFrameSines.setZero();
+    for (auto& p : mTracking.getActivePeaks())
+    { synthesizePeak(p, sampleRate, bandwidth, mFrameSines); }
+    if (mBufCount <= mTracking.minTrackLength())
+    { result.setZero(); }
     else
     {
-      ArrayXcd resultFrame = mBuf.front();
-      ArrayXd  resultMag = resultFrame.abs().real();
+      auto resultFrame = mBuf.col(mBufHead);
       for (index i = 0; i < mBins; i++)
       {
-        if (frameSines(i) >= resultMag(i))
+        double resultMag = std::abs(resultFrame(i));
+        if (mFrameSines(i) >= resultMag)
         {
           result(i, 0) = resultFrame(i);
           result(i, 1) = 0;
         }
         else
         {
-          double sineWeight = frameSines(i) / resultMag(i);
+          double sineWeight = mFrameSines(i) / resultMag;
           result(i, 0) = resultFrame(i) * sineWeight;
           result(i, 1) = resultFrame(i) * (1 - sineWeight);
         }
       }
-      mBuf.pop();
+      mBufHead = (mBufHead + 1) % mBuf.cols();
+      mBufCount--;
     }
     mTracking.prune();
-    out = _impl::asFluid(result);
     mCurrentFrame++;
   }
 
@@ -144,12 +145,13 @@ private:
     return mWindowTransform(floor) + frac * mInvWindowBinIncr * dY;
   }
 
-  ArrayXd synthesizePeak(SinePeak p, double sampleRate, index bandwidth)
+  // Adds the peak's window transform to the (at most bandwidth) bins it covers
+  void synthesizePeak(const SinePeak& p, double sampleRate, index bandwidth,
+                      ArrayXd& sine)
   {
     using namespace std;
-    index   halfBW = bandwidth / 2;
-    ArrayXd sine = ArrayXd::Zero(mBins);
-    double  freqBin = p.freq * 2 * (mBins - 1) / sampleRate;
+    index  halfBW = bandwidth / 2;
+    double freqBin = p.freq * 2 * (mBins - 1) / sampleRate;
     if (freqBin >= mBins - 1) freqBin = mBins - 1;
     if (freqBin < 0) freqBin = 0;
     index  freqBinFloor = lrint(floor(freqBin));
@@ -160,26 +162,40 @@ private:
     for (index i = freqBinCeil; pos < mWindowTransform.size() - 2 &&
                                 i < min(freqBinCeil + halfBW, mBins - 1);
          i++, pos += mWindowBinIncr)
-    { sine[i] = amp * interpolateWindow(pos); }
+    { sine[i] += amp * interpolateWindow(pos); }
     pos = (mWindowTransform.size() / 2) -
           ((freqBin - freqBinFloor) * mWindowBinIncr);
     for (index i = freqBinFloor;
          pos > 1 && i > max(freqBinFloor - halfBW, asSigned(0));
          i--, pos -= mWindowBinIncr)
-    { sine[i] = amp * interpolateWindow(pos); }
-    return sine;
+    { sine[i] += amp * interpolateWindow(pos); }
+  }
+
+  // Latency buffer of spectra: a ring of minTrackLength + 1 frames
+  void resetBuffer(index minTrackLength)
+  {
+    if (mBuf.rows() != mBins || mBuf.cols() != minTrackLength + 1)
+      mBuf.resize(mBins, minTrackLength + 1);
+    mBufHead = 0;
+    mBufCount = 0;
   }
 
-  PeakDetection        mPeakDetection;
-  PartialTracking      mTracking;
-  index                mBins{513};
-  index                mCurrentFrame{0};
-  std::queue<ArrayXcd> mBuf;
-  ArrayXd              mWindowTransform;
-  double               mScale{1.0};
-  bool                 mInitialized{false};
-  double               mWindowBinIncr;
-  double               mInvWindowBinIncr;
+  PeakDetection    mPeakDetection;
+  PartialTracking  mTracking;
+  index            mBins{513};
+  index            mCurrentFrame{0};
+  ArrayXXcd        mBuf;
+  index            mBufHead{0};
+  index            mBufCount{0};
+  ArrayXd          mMag;
+  ArrayXd          mLogMag;
+  ArrayXd          mFrameSines;
+  vector<SinePeak> mPeaks;
+  ArrayXd          mWindowTransform;
+  double           mScale{1.0};
+  bool             mInitialized{false};
+  double           mWindowBinIncr;
+  double           mInvWindowBinIncr;
 };
 } // namespace algorithm
 } // namespace fluid
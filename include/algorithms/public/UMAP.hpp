@@ -2,13 +2,18 @@
 #include "KDTree.hpp"
 #include "../util/DistanceFuncs.hpp"
 #include "../util/FluidEigenMappings.hpp"
+#include "../util/NNDescent.hpp"
+#include "../util/ParallelFor.hpp"
+#include "../util/RandomGenerator.hpp"
 #include "../util/SpectralEmbedding.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Core>
 #include <Eigen/Sparse>
 #include <cassert>
 #include <cmath>
+#include <numeric>
 #include <random>
+#include <vector>
 #include <unsupported/Eigen/NonLinearOptimization>
 #include <unsupported/Eigen/NumericalDiff>
 
@@ -53,16 +58,26 @@ public:
   using ArrayXd = Eigen::ArrayXd;
   using ArrayXi = Eigen::ArrayXi;
   using VectorXd = Eigen::VectorXd;
+  using RowMajorArrayXXd =
+      Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
   using SparseMatrixXd = Eigen::SparseMatrix<double>;
   using DataSet = FluidDataSet<std::string, double, 1>;
   template <typename T>
   using Ref = Eigen::Ref<T>;
 
+  enum GraphMethod { kExact, kApproximate };
+
   void init(RealMatrixView embedding, KDTree tree, index k, double a, double b)
   {
     mEmbedding = _impl::asEigen<Eigen::Array>(embedding);
-    mTree = tree;
+    // a tree loaded from its flat form numbers its points in flat order
+    KDTree::FlatData flat = tree.toFlat();
+    mEmbeddingRows.resize(asUnsigned(flat.ids.size()));
+    for (index i = 0; i < flat.ids.size(); i++)
+      mEmbeddingRows[asUnsigned(i)] = std::stoi(flat.ids(i));
+    mTree.fromFlat(flat);
     mK = k;
+    initPointBuffers();
     mAB = VectorXd(2);
     mAB << a, b;
     mInitialized = true;
@@ -96,22 +111,37 @@ public:
 
   bool initialized() const { return mInitialized; }
 
+  /// The k-nearest-neighbour graph is found exactly with the KD tree, or
+  /// approximately by NN-descent, which scales better in high dimensions.
+  /// numThreads = 0 uses all cores. A seed >= 0 fixes every random draw and
+  /// lays out on one thread, whatever numThreads, so that the result is
+  /// reproducible: the layout's lock-free updates would otherwise interleave
+  /// differently from run to run
   DataSet train(DataSet& in, index k = 15, index dims = 2, double minDist = 0.1,
-                index maxIter = 200, double learningRate = 1.0)
+                index maxIter = 200, double learningRate = 1.0,
+                index graphMethod = kExact, index numThreads = 0,
+                index seed = -1)
   {
     using namespace Eigen;
     using namespace _impl;
     using namespace std;
     SpectralEmbedding      spectralEmbedding;
     index                  n = in.size();
+    mRandomGenerator = makeGenerator(seed);
     FluidTensor<string, 1> ids{in.getIds()};
     FluidTensor<string, 1> newIds(n);
     for (index i = 0; i < n; i++) newIds(i) = to_string(i);
     mTree = KDTree(DataSet(newIds, in.getData()));
+    mEmbeddingRows.resize(asUnsigned(n));
+    iota(mEmbeddingRows.begin(), mEmbeddingRows.end(), 0);
     SparseMatrixXd knnGraph = SparseMatrixXd(in.size(), in.size());
     ArrayXXd       dists = ArrayXXd::Zero(in.size(), k);
     mK = k;
-    makeGraph(in, mK, knnGraph, dists, true);
+    initPointBuffers();
+    if (graphMethod == kApproximate && k < n)
+      makeApproximateGraph(in, mK, knnGraph, dists, seed);
+    else
+      makeGraph(in, mK, knnGraph, dists, true);
     ArrayXd sigma = findSigma(k, dists);
     computeHighDimProb(dists, sigma, knnGraph);
     SparseMatrixXd knnGraphT = knnGraph.transpose();
@@ -127,15 +157,18 @@ public:
     computeEpochsPerSample(knnGraph, epochsPerSample);
     epochsPerSample = (epochsPerSample == 0).select(-1, epochsPerSample);
     optimizeLayout(mEmbedding, mEmbedding, rowIndices, colIndices,
-                   epochsPerSample, true, learningRate, maxIter);
+                   epochsPerSample, true, learningRate, maxIter,
+                   layoutThreads(numThreads, seed));
     DataSet out(ids, _impl::asFluid(mEmbedding));
     mInitialized = true;
     return out;
   }
 
-  DataSet transform(DataSet& in, index maxIter = 200, double learningRate = 1.0)
+  DataSet transform(DataSet& in, index maxIter = 200, double learningRate = 1.0,
+                    index numThreads = 0, index seed = -1)
   {
     if (!mInitialized) return DataSet();
+    mRandomGenerator = makeGenerator(seed);
     SparseMatrixXd knnGraph(in.size(), mEmbedding.rows());
     ArrayXXd       dists = ArrayXXd::Zero(in.size(), mK);
     makeGraph(in, mK, knnGraph, dists, false);
@@ -152,34 +185,38 @@ public:
     computeEpochsPerSample(knnGraph, epochsPerSample);
     epochsPerSample = (epochsPerSample == 0).select(-1, epochsPerSample);
     optimizeLayout(embedding, mEmbedding, rowIndices, colIndices,
-                   epochsPerSample, false, learningRate, maxIter);
+                   epochsPerSample, false, learningRate, maxIter,
+                   layoutThreads(numThreads, seed));
     DataSet out(in.getIds(), _impl::asFluid(embedding));
     return out;
   }
 
 
+  /// The same initial placement as transform(), without the optimisation:
+  /// the neighbours' embeddings weighted by their membership strengths. All
+  /// buffers are allocated by train() or init(), so this can run in real time
   void transformPoint(RealVectorView in, RealVectorView out)
   {
     if (!mInitialized) return;
-    SparseMatrixXd knnGraph(1, mEmbedding.rows());
-    ArrayXXd       dists = ArrayXXd::Zero(1, mK);
-    knnGraph.reserve(mK);
-    auto nearest = mTree.kNearest(in, mK);
-    auto nearestIds = nearest.getIds();
-    auto distances = nearest.getData().col(0);
-    for (index j = 0; j < mK; j++)
+    mTree.kNearest(in, mK, mNeighbours);
+    index numNeighbours = asSigned(mNeighbours.size());
+    if (numNeighbours == 0) return;
+    auto dists = mNeighbourDists.head(numNeighbours);
+    for (index j = 0; j < numNeighbours; j++)
+      dists(j) = mNeighbours[asUnsigned(j)].first;
+    double sigma = findPointSigma(mK, dists);
+    double totalWeight = 0;
+    out.fill(0);
+    for (index j = 0; j < numNeighbours; j++)
     {
-      index neighborIndex = stoi(nearestIds(j));
-      dists(0, j) = distances(j);
-      knnGraph.insert(0, neighborIndex) = distances(j);
+      double weight = std::exp(-(dists(j) - dists(0)) / sigma);
+      index  row = mEmbeddingRows[asUnsigned(
+          mNeighbours[asUnsigned(j)].second->row)];
+      for (index d = 0; d < out.size(); d++)
+        out(d) += weight * mEmbedding(row, d);
+      totalWeight += weight;
     }
-    knnGraph.makeCompressed();
-    ArrayXd sigma = findSigma(mK, dists);
-    computeHighDimProb(dists, sigma, knnGraph);
-    normalizeRows(knnGraph);
-    ArrayXXd embedding = initTransformEmbedding(knnGraph, mEmbedding, 1);
-    ArrayXd  result = embedding.row(0);
-    out = _impl::asFluid(result);
+    for (index d = 0; d < out.size(); d++) out(d) /= totalWeight;
   }
 
 
@@ -206,39 +243,45 @@ private:
   ArrayXd findSigma(index k, Ref<ArrayXXd> dists, index maxIter = 64,
                     double tolerance = 1e-5)
   {
-    using namespace std;
-    double  target = log2(k);
     ArrayXd result = ArrayXd::Zero(dists.rows());
     for (index i = 0; i < dists.rows(); i++)
+      result(i) = findPointSigma(k, dists.row(i), maxIter, tolerance);
+    return result;
+  }
+
+  // bisection for the sigma of one point, given its neighbours' distances
+  template <typename Distances>
+  double findPointSigma(index k, const Distances& dists, index maxIter = 64,
+                        double tolerance = 1e-5)
+  {
+    using namespace std;
+    double target = log2(k);
+    index  iter = maxIter;
+    double lo = 0;
+    double hi = infinity;
+    double mid = 1.0;
+    double rho = dists(0);
+    while (iter-- > 0)
     {
-      index  iter = maxIter;
-      double lo = 0;
-      double hi = infinity;
-      double mid = 1.0;
-      double rho = dists(i, 0);
-      while (iter-- > 0)
+      double pSum = 0;
+      for (index j = 1; j < dists.size(); j++)
       {
-        double pSum = 0;
-        for (index j = 1; j < dists.cols(); j++)
-        {
-          double d = dists(i, j) - rho;
-          pSum += (d <= 0 ? 1.0 : exp(-(d / mid)));
-        }
-        if (abs(pSum - target) < tolerance) break;
-        if (pSum > target)
-        {
-          hi = mid;
-          mid = (lo + hi) / 2.0;
-        }
-        else
-        {
-          lo = mid;
-          mid = (hi == infinity ? mid * 2 : (lo + hi) / 2.0);
-        }
+        double d = dists(j) - rho;
+        pSum += (d <= 0 ? 1.0 : exp(-(d / mid)));
+      }
+      if (abs(pSum - target) < tolerance) break;
+      if (pSum > target)
+      {
+        hi = mid;
+        mid = (lo + hi) / 2.0;
+      }
+      else
+      {
+        lo = mid;
+        mid = (hi == infinity ? mid * 2 : (lo + hi) / 2.0);
       }
-      result(i) = mid;
     }
-    return result;
+    return mid;
   }
 
   void computeHighDimProb(const Ref<ArrayXXd>& dists, const Ref<ArrayXd>& sigma,
@@ -269,15 +312,32 @@ private:
     auto data = in.getData();
     for (index i = 0; i < in.size(); i++)
     {
-      auto nearest = mTree.kNearest(data.row(i), discardFirst ? k + 1 : k);
-      auto nearestIds = nearest.getIds();
-      auto distances = nearest.getData().col(0);
+      mTree.kNearest(data.row(i), discardFirst ? k + 1 : k, mNeighbours);
       for (index j = 0; j < k; j++)
       {
-        index pos = discardFirst ? j + 1 : j;
-        index neighborIndex = stoi(nearestIds(pos));
-        dists(i, j) = distances(pos);
-        graph.insert(i, neighborIndex) = distances(pos);
+        auto& neighbour = mNeighbours[asUnsigned(discardFirst ? j + 1 : j)];
+        index neighborIndex = mEmbeddingRows[asUnsigned(neighbour.second->row)];
+        dists(i, j) = neighbour.first;
+        graph.insert(i, neighborIndex) = neighbour.first;
+      }
+    }
+  }
+
+  void makeApproximateGraph(const DataSet& in, index k, SparseMatrixXd& graph,
+                            Ref<ArrayXXd> dists, index seed)
+  {
+    using namespace Eigen;
+    Array<index, Dynamic, Dynamic, RowMajor>  indices(in.size(), k);
+    Array<double, Dynamic, Dynamic, RowMajor> distances(in.size(), k);
+    NNDescent(seed).process(_impl::asEigen<Array>(in.getData()), k, indices,
+                            distances);
+    graph.reserve(in.size() * k);
+    for (index i = 0; i < in.size(); i++)
+    {
+      for (index j = 0; j < k; j++)
+      {
+        dists(i, j) = distances(i, j);
+        graph.insert(i, indices(i, j)) = distances(i, j);
       }
     }
   }
@@ -286,8 +346,9 @@ private:
   {
     // based on umap python implementation
     double   expansion = 10.0 / embedding.abs().maxCoeff();
-    ArrayXXd noise =
-        1e-4 * ArrayXXd::Random(embedding.rows(), embedding.cols()); // uniform
+    ArrayXXd noise = 1e-4 * uniformRandom<ArrayXXd>(embedding.rows(),
+                                                    embedding.cols(),
+                                                    mRandomGenerator);
     ArrayXXd result = (embedding * expansion) + noise;
     ArrayXd  min = result.colwise().minCoeff();
     ArrayXd  max = result.colwise().maxCoeff();
@@ -318,70 +379,113 @@ private:
     });
   }
 
+  // seeded runs lay out on one thread, as which of two colliding lock-free
+  // updates wins depends on timing
+  static index layoutThreads(index numThreads, index seed)
+  {
+    return seed >= 0 ? 1 : numThreads;
+  }
+
+  // Stochastic gradient descent over the graph's edges, sharing each epoch's
+  // edges between threads without locking (Hogwild, Recht et al. 2011): the
+  // embedding is low-dimensional and edges rarely collide, so occasional
+  // stale reads do not hurt convergence. The edges are split into a fixed
+  // number of chunks, each with its own generator, whatever the number of
+  // threads: one thread then gives the same layout for the same seed on any
+  // machine, but with more, which update wins a collision depends on timing,
+  // so results vary slightly between runs (see layoutThreads()). When
+  // updateReference is set, embedding and reference are the same matrix
   void optimizeLayout(Ref<ArrayXXd> embedding, Ref<ArrayXXd> reference,
                       Ref<ArrayXi> embIndices, Ref<ArrayXi> refIndices,
                       Ref<ArrayXd> epochsPerSample, bool updateReference,
-                      double learningRate, index maxIter, double gamma = 1.0)
+                      double learningRate, index maxIter, index numThreads,
+                      double gamma = 1.0)
   {
     using namespace std;
     double alpha = learningRate;
     double negativeSampleRate = 5.0;
-    auto distance = DistanceFuncs::map()[DistanceFuncs::Distance::kSqEuclidean];
-    double                          a = mAB(0);
-    double                          b = mAB(1);
-    random_device                   rd;
-    mt19937                         mt(rd());
-    uniform_int_distribution<index> randomInt(0, reference.rows() - 1);
+    double a = mAB(0);
+    double b = mAB(1);
+    double bound = 4.0; // based on umap python implementation
+    index  dims = embedding.cols();
+    index  numEdges = epochsPerSample.size();
+    index  numChunks = max<index>(min(mLayoutChunks, numEdges), 1);
+    index  threads = numThreads > 0 ? numThreads : hardwareThreads();
     ArrayXd epochsPerNegativeSample = epochsPerSample / negativeSampleRate;
     ArrayXd nextEpoch = epochsPerSample;
     ArrayXd nextNegEpoch = epochsPerNegativeSample;
-    ArrayXd bound = VectorXd::Constant(
-        embedding.cols(), 4); // based on umap python implementation
+    // rows as contiguous runs of dims values
+    RowMajorArrayXXd layout = embedding;
+    RowMajorArrayXXd referenceLayout;
+    if (!updateReference) referenceLayout = reference;
+    double* embeddingData = layout.data();
+    double* referenceData =
+        updateReference ? layout.data() : referenceLayout.data();
+    vector<mt19937> generators = makeGenerators(numChunks, mRandomGenerator);
+    auto            clip = [bound](double x) {
+      return max(-bound, min(bound, x));
+    };
     for (index i = 0; i < maxIter; i++)
     {
-      for (index j = 0; j < epochsPerSample.size(); j++)
-      {
-        if (nextEpoch(j) > i) continue;
-        ArrayXd current = embedding.row(embIndices(j));
-        ArrayXd other = reference.row(refIndices(j));
-        double dist = distance(current, other); // todo: try to have dist member
-        double gradCoef = 0;
-        ArrayXd grad;
-        if (dist > 0)
+      parallelFor(numChunks, [&](index chunk) {
+        // each chunk draws from its own generator and distribution
+        mt19937&                        mt = generators[asUnsigned(chunk)];
+        uniform_int_distribution<index> randomInt(0, reference.rows() - 1);
+        index                           end =
+            numEdges * (chunk + 1) / numChunks;
+        for (index j = numEdges * chunk / numChunks; j < end; j++)
         {
-          gradCoef = -2.0 * a * b * pow(dist, b - 1.0);
-          gradCoef /= a * pow(dist, b) + 1.0;
-        }
-        grad = (gradCoef * (current - other)).cwiseMin(bound).cwiseMax(-bound);
-        current += grad * alpha;
-        if (updateReference) other += -grad * alpha;
-        nextEpoch(j) += epochsPerSample(j);
-        index numNegative = static_cast<index>((i - nextNegEpoch(j)) /
-                                                 epochsPerNegativeSample(j));
-        for (index k = 0; k < numNegative; k++)
-        {
-          index negativeIndex = randomInt(mt);
-          if (negativeIndex == embIndices(j)) continue;
-          ArrayXd negative = reference.row(negativeIndex);
-          dist = distance(current, negative);
-          gradCoef = 0;
-          grad = VectorXd::Constant(reference.cols(), 4.0);
+          if (nextEpoch(j) > i) continue;
+          double* current = embeddingData + embIndices(j) * dims;
+          double* other = referenceData + refIndices(j) * dims;
+          double dist = 0;
+          for (index d = 0; d < dims; d++)
+            dist += (current[d] - other[d]) * (current[d] - other[d]);
+          double gradCoef = 0;
           if (dist > 0)
           {
-            gradCoef = 2.0 * gamma * b;
-            gradCoef /= (0.001 + dist) * (a * pow(dist, b) + 1);
-            grad = (gradCoef * (current - negative))
-                       .cwiseMin(bound)
-                       .cwiseMax(-bound);
+            double distPowB = pow(dist, b);
+            gradCoef = -2.0 * a * b * distPowB / dist;
+            gradCoef /= a * distPowB + 1.0;
+          }
+          for (index d = 0; d < dims; d++)
+          {
+            double grad = clip(gradCoef * (current[d] - other[d]));
+            current[d] += grad * alpha;
+            if (updateReference) other[d] -= grad * alpha;
+          }
+          nextEpoch(j) += epochsPerSample(j);
+          index numNegative = static_cast<index>((i - nextNegEpoch(j)) /
+                                                 epochsPerNegativeSample(j));
+          for (index k = 0; k < numNegative; k++)
+          {
+            index negativeIndex = randomInt(mt);
+            if (negativeIndex == embIndices(j)) continue;
+            const double* negative = referenceData + negativeIndex * dims;
+            dist = 0;
+            for (index d = 0; d < dims; d++)
+              dist += (current[d] - negative[d]) * (current[d] - negative[d]);
+            if (dist > 0)
+            {
+              gradCoef = 2.0 * gamma * b;
+              gradCoef /= (0.001 + dist) * (a * pow(dist, b) + 1);
+              for (index d = 0; d < dims; d++)
+              {
+                double grad = clip(gradCoef * (current[d] - negative[d]));
+                current[d] += grad * alpha;
+              }
+            }
+            else
+            {
+              for (index d = 0; d < dims; d++) current[d] += bound * alpha;
+            }
           }
-          current += grad * alpha;
+          nextNegEpoch(j) += numNegative * epochsPerNegativeSample(j);
         }
-        nextNegEpoch(j) += numNegative * epochsPerNegativeSample(j);
-        embedding.row(embIndices(j)) = current;
-        if (updateReference) reference.row(refIndices(j)) = other;
-      }
+      }, threads);
       alpha = learningRate * (1.0 - (i / double(maxIter)));
     }
+    embedding = layout;
   }
 
   ArrayXXd initTransformEmbedding(const SparseMatrixXd& graph,
@@ -394,6 +498,12 @@ private:
     return embedding;
   }
 
+  void initPointBuffers()
+  {
+    mNeighbours.reserve(asUnsigned(mK + 1));
+    mNeighbourDists.resize(mK);
+  }
+
   void normalizeRows(const SparseMatrixXd& graph)
   {
     ArrayXd sums = ArrayXd::Zero(graph.innerSize());
@@ -403,11 +513,17 @@ private:
   }
 
 private:
-  KDTree   mTree;
-  index    mK;
-  VectorXd mAB;
-  ArrayXXd mEmbedding;
-  bool     mInitialized{false};
+  KDTree       mTree;
+  index        mK;
+  VectorXd     mAB;
+  ArrayXXd     mEmbedding;
+  bool         mInitialized{false};
+  std::mt19937 mRandomGenerator;
+  index        mLayoutChunks{64};
+
+  std::vector<index>                mEmbeddingRows; // by KD tree node row
+  std::vector<KDTree::knnCandidate> mNeighbours;
+  ArrayXd                           mNeighbourDists;
 };
 }; // namespace algorithm
 }; // namespace fluid
@@ -10,14 +10,13 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #pragma once
 
-#include "ConvolutionTools.hpp"
-#include "Toeplitz.hpp"
 #include "../public/WindowFuncs.hpp"
 #include "../../data/FluidIndex.hpp"
 #include <Eigen/Eigen>
 #include <algorithm>
 #include <cmath>
 #include <functional>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -30,7 +29,11 @@ class ARModel
   using VectorXd = Eigen::VectorXd;
 
 public:
-  ARModel(index order) : mParameters(VectorXd::Zero(order)) {}
+  ARModel(index order)
+      : mParameters(VectorXd::Zero(order)),
+        mAutocorrelation(VectorXd::Zero(order + 1)),
+        mReflection(VectorXd::Zero(order))
+  {}
 
   const double* getParameters() const { return mParameters.data(); }
   double        variance() const { return mVariance; }
@@ -52,10 +55,6 @@ public:
 
   double backwardPrediction(const double* input)
   {
-    struct Identity
-    {
-      index operator()(index a) { return a; }
-    };
     return modelPredict<Identity>(input);
   }
 
@@ -71,17 +70,22 @@ public:
 
   void forwardErrorArray(double* errors, const double* input, index size)
   {
-    modelErrorArray<&ARModel::forwardError>(errors, input, size);
+    modelErrorArray<std::negate<index>>(errors, input, size);
   }
 
   void backwardErrorArray(double* errors, const double* input, index size)
   {
-    modelErrorArray<&ARModel::backwardError>(errors, input, size);
+    modelErrorArray<Identity>(errors, input, size);
   }
 
   void setMinVariance(double variance) { mMinVariance = variance; }
 
 private:
+  struct Identity
+  {
+    index operator()(index a) { return a; }
+  };
+
   template <typename Op>
   double modelPredict(const double* input)
   {
@@ -99,16 +103,64 @@ private:
     return input[0] - (this->*Method)(input);
   }
 
-  template <double (ARModel::*Method)(const double*)>
+  // The FIR filter is applied one coefficient at a time over the whole block,
+  // which vectorises, while keeping the summation order of modelPredict()
+  template <typename Op>
+  void modelPredictArray(double* predictions, const double* input, index size)
+  {
+    Eigen::Map<ArrayXd> out(predictions, size);
+    out.setZero();
+    for (index i = 0; i < mParameters.size(); i++)
+      out += mParameters(i) *
+             Eigen::Map<const ArrayXd>(input + Op()(i + 1), size);
+  }
+
+  template <typename Op>
   void modelErrorArray(double* errors, const double* input, index size)
   {
-    for (index i = 0; i < size; i++) errors[i] = (this->*Method)(input + i);
+    modelPredictArray<Op>(errors, input, size);
+    Eigen::Map<ArrayXd> out(errors, size);
+    out = Eigen::Map<const ArrayXd>(input, size) - out;
+  }
+
+  // Circular autocorrelation of the frame, for the lags 0 to order only
+  void autocorrelate(index size)
+  {
+    index maxLag = std::min(order(), size - 1);
+    mAutocorrelation.setZero();
+    for (index lag = 0; lag <= maxLag; lag++)
+    {
+      mAutocorrelation(lag) =
+          mFrame.head(size - lag).dot(mFrame.segment(lag, size - lag)) +
+          mFrame.tail(lag).dot(mFrame.head(lag));
+    }
+  }
+
+  // Solve the Yule-Walker equations for the (Toeplitz) autocorrelation matrix
+  // with the Levinson-Durbin recursion, returning the prediction error
+  double levinsonDurbin()
+  {
+    index  p = order();
+    double error = mAutocorrelation(0);
+    mParameters.setZero();
+    for (index m = 0; m < p; m++)
+    {
+      if (error <= 0) break;
+      double acc = mAutocorrelation(m + 1);
+      for (index j = 0; j < m; j++)
+        acc -= mParameters(j) * mAutocorrelation(m - j);
+      double k = acc / error;
+      mReflection.head(m) = mParameters.head(m).reverse();
+      mParameters.head(m) -= k * mReflection.head(m);
+      mParameters(m) = k;
+      error *= (1 - k * k);
+    }
+    return error;
   }
 
   void directEstimate(const double* input, index size, bool updateVariance)
   {
-    // copy input to a 32 byte aligned block (otherwise risk segfaults on Linux)
-    VectorXd frame = Eigen::Map<const VectorXd>(input, size);
+    mFrame = Eigen::Map<const VectorXd>(input, size);
 
     if (mUseWindow)
     {
@@ -118,46 +170,20 @@ private:
         WindowFuncs::map()[WindowFuncs::WindowTypes::kHann](size, mWindow);
       }
 
-      frame.array() *= mWindow;
+      mFrame.array() *= mWindow;
     }
 
+    autocorrelate(size);
+    double error = levinsonDurbin();
 
-    VectorXd autocorrelation(size);
-    algorithm::autocorrelateReal(autocorrelation.data(), frame.data(),
-                                 asUnsigned(size));
-
-    // Resize to the desired order (only keep coefficients for up to the order
-    // we need)
-    double pN = mParameters.size() < size ? autocorrelation(mParameters.size())
-                                          : autocorrelation(0);
-    autocorrelation.conservativeResize(mParameters.size());
-
-    // Form a toeplitz matrix
-    MatrixXd mat = toeplitz(autocorrelation);
-
-    // Yule Walker
-    autocorrelation(0) = pN;
-    std::rotate(autocorrelation.data(), autocorrelation.data() + 1,
-                autocorrelation.data() + mParameters.size());
-    mParameters = mat.llt().solve(autocorrelation);
-
-    if (updateVariance)
-    {
-      // Calculate variance
-      double variance = mat(0, 0);
-
-      for (index i = 0; i < mParameters.size() - 1; i++)
-        variance -= mParameters(i) * mat(0, i + 1);
-
-      setVariance((variance - (mParameters(mParameters.size() - 1) * pN)) /
-                  size);
-    }
+    if (updateVariance) setVariance(error / size);
   }
 
   void robustEstimate(const double* input, index size, index nIterations,
                       double robustFactor)
   {
-    std::vector<double> estimates(asUnsigned(size + mParameters.size()));
+    std::vector<double>& estimates = mEstimates;
+    estimates.resize(asUnsigned(size + mParameters.size()));
 
     // Calculate an initial estimate of parameters
     directEstimate(input, size, true);
@@ -185,13 +211,15 @@ private:
                       double robustFactor)
   {
     double residualSqSum = 0.0;
+    double cs = robustFactor * sqrt(mVariance);
+
+    mPredictions.resize(asUnsigned(size));
+    modelPredictArray<std::negate<index>>(mPredictions.data(), estimates, size);
 
-    // Iterate to find new filtered input
     for (index i = 0; i < size; i++)
     {
       const double residual =
-          robustResidual(input[i], fowardPrediction(estimates + i),
-                         robustFactor * sqrt(mVariance));
+          robustResidual(input[i], mPredictions[asUnsigned(i)], cs);
       residualSqSum += residual * residual;
     }
 
@@ -227,11 +255,16 @@ private:
     return fabs(x) > 1 ? std::copysign(1.0, x) : x;
   }
 
-  VectorXd mParameters;
-  double   mVariance{0.0};
-  ArrayXd  mWindow;
-  bool     mUseWindow{true};
-  double   mMinVariance{0.0};
+  VectorXd            mParameters;
+  VectorXd            mAutocorrelation;
+  VectorXd            mReflection;
+  VectorXd            mFrame;
+  std::vector<double> mEstimates;
+  std::vector<double> mPredictions;
+  double              mVariance{0.0};
+  ArrayXd             mWindow;
+  bool                mUseWindow{true};
+  double              mMinVariance{0.0};
 };
 
 } // namespace algorithm
@@ -11,10 +11,12 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "AlgorithmUtils.hpp"
+#include "ParallelFor.hpp"
+#include "../../data/FluidIndex.hpp"
 #include <Eigen/Core>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
-#include <map>
 
 namespace fluid {
 namespace algorithm {
@@ -34,69 +36,174 @@ public:
     kJS
   };
 
-  using ArrayXcd = Eigen::ArrayXcd;
   using ArrayXd = Eigen::ArrayXd;
   using MatrixXd = Eigen::MatrixXd;
-  using DistanceFuncsMap =
-      std::map<Distance, std::function<double(ArrayXd, ArrayXd)>>;
 
-  static DistanceFuncsMap& map()
+  // Each distance is a function object templated on its arguments, so rows,
+  // columns and blocks are passed as Eigen expressions without being copied
+  struct Manhattan
   {
-    static DistanceFuncsMap _funcs = {
-        {Distance::kManhattan,
-         [](ArrayXd x, ArrayXd y) { return (x - y).abs().sum(); }},
-        {Distance::kEuclidean,
-         [](ArrayXd x, ArrayXd y) {
-           return std::sqrt((x - y).square().sum());
-         }},
-        {Distance::kSqEuclidean,
-         [](ArrayXd x, ArrayXd y) { return (x - y).square().sum(); }},
-        {Distance::kMax,
-         [](ArrayXd x, ArrayXd y) { return (x - y).abs().maxCoeff(); }},
-        {Distance::kMin,
-         [](ArrayXd x, ArrayXd y) { return (x - y).abs().minCoeff(); }},
-        {Distance::kKL,
-         [](ArrayXd x, ArrayXd y) {
-           auto   logX = x.max(epsilon).log(), logY = y.max(epsilon).log();
-           double d1 = (x * (logX - logY)).sum();
-           double d2 = (y * (logY - logX)).sum();
-           return d1 + d2;
-         }},
-        {Distance::kCosine, [](ArrayXd x, ArrayXd y) {
-           double norm = x.matrix().norm() * y.matrix().norm();
-           double dot = x.matrix().dot(y.matrix());
-           return 1 - (dot / norm);
-         }},
-         {Distance::kJS,
-           [](ArrayXd x, ArrayXd y) {
-             x = x.max(epsilon);
-             y = y.max(epsilon);
-             x = x / x.sum();
-             y = y / y.sum();
-             ArrayXd m = (0.5 * x) + (0.5 * y);
-             ArrayXd logX = x.log(),
-              logY = y.log(),
-              logM = m.log();
-              double d1 = (x * (logX - logM)).sum();
-              double d2 =  (y * (logY - logM)).sum();
-            return std::sqrt(0.5*(d1 + d2));
-          }}
-       };
-    return _funcs;
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).abs().sum();
+    }
+  };
+
+  struct Euclidean
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return std::sqrt((x - y).square().sum());
+    }
+  };
+
+  struct SqEuclidean
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).square().sum();
+    }
+  };
+
+  struct Max
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).abs().maxCoeff();
+    }
+  };
+
+  struct Min
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      return (x - y).abs().minCoeff();
+    }
+  };
+
+  struct KL
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      auto   logX = x.max(epsilon).log(), logY = y.max(epsilon).log();
+      double d1 = (x * (logX - logY)).sum();
+      double d2 = (y * (logY - logX)).sum();
+      return d1 + d2;
+    }
+  };
+
+  struct Cosine
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      double norm = x.matrix().norm() * y.matrix().norm();
+      double dot = x.matrix().dot(y.matrix());
+      return 1 - (dot / norm);
+    }
+  };
+
+  struct JS
+  {
+    template <typename X, typename Y>
+    double operator()(const Eigen::ArrayBase<X>& x,
+                      const Eigen::ArrayBase<Y>& y) const
+    {
+      auto px = x.max(epsilon) / x.max(epsilon).sum();
+      auto py = y.max(epsilon) / y.max(epsilon).sum();
+      auto logM = ((0.5 * px) + (0.5 * py)).log();
+      double d1 = (px * (px.log() - logM)).sum();
+      double d2 = (py * (py.log() - logM)).sum();
+      return std::sqrt(0.5 * (d1 + d2));
+    }
+  };
+
+  // Call op with the function object for a distance: the choice is made once,
+  // and op's loops are compiled for that distance
+  template <typename Op>
+  static decltype(auto) dispatch(Distance distance, Op&& op)
+  {
+    switch (distance)
+    {
+    case Distance::kManhattan: return op(Manhattan{});
+    case Distance::kEuclidean: return op(Euclidean{});
+    case Distance::kSqEuclidean: return op(SqEuclidean{});
+    case Distance::kMax: return op(Max{});
+    case Distance::kMin: return op(Min{});
+    case Distance::kKL: return op(KL{});
+    case Distance::kCosine: return op(Cosine{});
+    case Distance::kJS: return op(JS{});
+    }
+    assert(false && "Unknown distance");
+    return op(Euclidean{});
   }
 };
 
-Eigen::MatrixXd DistanceMatrix(Eigen::Ref<Eigen::MatrixXd> X, index distance)
+// Distances between all pairs of rows of X. Squared and plain Euclidean
+// distances come from the Gram matrix X X^T, i.e. a single matrix product;
+// the others are computed for the upper triangle only, in tiles of points
+// that stay in cache, with rows of tiles shared between threads
+inline Eigen::MatrixXd DistanceMatrix(Eigen::Ref<const Eigen::MatrixXd> X,
+                                      index distance)
 {
-  auto            dist = static_cast<DistanceFuncs::Distance>(distance);
-  Eigen::MatrixXd D = Eigen::MatrixXd::Zero(X.rows(), X.rows());
-  for (index i = 0; i < X.rows(); i++)
+  using namespace Eigen;
+  using Distance = DistanceFuncs::Distance;
+  auto     dist = static_cast<Distance>(distance);
+  index    n = X.rows();
+  MatrixXd D = MatrixXd::Zero(n, n);
+  if (dist == Distance::kEuclidean || dist == Distance::kSqEuclidean)
   {
-    for (index j = 0; j < X.rows(); j++)
+    // |x - y|^2 = |x|^2 + |y|^2 - 2 x.y, clamped against rounding
+    VectorXd norms = X.rowwise().squaredNorm();
+    bool     root = dist == Distance::kEuclidean;
+    D.selfadjointView<Lower>().rankUpdate(X, -2.0);
+    for (index j = 0; j < n; j++)
     {
-      D(i, j) = DistanceFuncs::map()[dist](X.row(i).array(), X.row(j).array());
+      D(j, j) = 0;
+      for (index i = j + 1; i < n; i++)
+      {
+        double d = std::max(D(i, j) + norms(i) + norms(j), 0.0);
+        D(i, j) = root ? std::sqrt(d) : d;
+      }
     }
+    D.triangularView<StrictlyUpper>() = D.transpose();
+    return D;
   }
+  constexpr index tileSize = 64;
+  MatrixXd        points = X.transpose(); // one contiguous column per point
+  index           nTiles = (n + tileSize - 1) / tileSize;
+  DistanceFuncs::dispatch(dist, [&](auto f) {
+    parallelFor(nTiles, [&](index tile) {
+      index rowStart = tile * tileSize;
+      index rowEnd = std::min(rowStart + tileSize, n);
+      for (index colStart = rowStart; colStart < n; colStart += tileSize)
+      {
+        index colEnd = std::min(colStart + tileSize, n);
+        for (index i = rowStart; i < rowEnd; i++)
+        {
+          for (index j = std::max(i, colStart); j < colEnd; j++)
+          {
+            double d = f(points.col(i).array(), points.col(j).array());
+            D(i, j) = d;
+            D(j, i) = d;
+          }
+        }
+      }
+    });
+  });
   return D;
 }
 
@@ -107,13 +214,13 @@ Eigen::MatrixXd DistanceMatrix(const Eigen::PlainObjectBase<Derived>& X,
 {
   auto            dist = static_cast<DistanceFuncs::Distance>(distance);
   Eigen::MatrixXd D = Eigen::MatrixXd::Zero(X.rows(), Y.rows());
-  for (index i = 0; i < X.rows(); i++)
-  {
-    for (index j = 0; j < Y.rows(); j++)
+  DistanceFuncs::dispatch(dist, [&](auto f) {
+    for (index i = 0; i < X.rows(); i++)
     {
-      D(i, j) = DistanceFuncs::map()[dist](X.row(i).array(), Y.row(j).array());
+      for (index j = 0; j < Y.rows(); j++)
+      { D(i, j) = f(X.row(i).array(), Y.row(j).array()); }
     }
-  }
+  });
   return D;
 }
 
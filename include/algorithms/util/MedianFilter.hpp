@@ -12,56 +12,102 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
+#include <Eigen/Core>
+#include <algorithm>
 #include <cassert>
-#include <deque>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
 
+// Sliding median in O(log n) per sample, after Hardieck's "mediator": the
+// window is kept as a max-heap (negative positions) and a min-heap (positive
+// positions) either side of the median (position 0), and each sample in the
+// ring buffer knows its position in the heaps, so the oldest one can be
+// replaced in place by the newest one
 class MedianFilter
 {
 
 public:
+  MedianFilter() = default;
+
+  MedianFilter(index maxSize)
+  {
+    mData.reserve(asUnsigned(maxSize));
+    mPos.reserve(asUnsigned(maxSize));
+    mHeapStorage.reserve(asUnsigned(maxSize));
+  }
+
   void init(index size)
   {
     assert(size >= 3);
     assert(size % 2);
     mFilterSize = size;
     mMiddle = (mFilterSize - 1) / 2;
-    mUnsorted.resize(asUnsigned(mFilterSize), 0);
-    mSorted.resize(asUnsigned(mFilterSize), 0);
-    std::fill(mUnsorted.begin(), mUnsorted.end(), 0);
-    std::fill(mSorted.begin(), mSorted.end(), 0);
+    mData.resize(asUnsigned(mFilterSize));
+    mPos.resize(asUnsigned(mFilterSize));
+    mHeapStorage.resize(asUnsigned(mFilterSize));
     mInitialized = true;
+    reset();
+  }
+
+  /// Refill the window with zeros
+  void reset()
+  {
+    assert(mInitialized);
+    std::fill(mData.begin(), mData.end(), 0);
+    for (index i = 0; i < mFilterSize; i++)
+    {
+      index pos = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+      mPos[asUnsigned(i)] = pos;
+      heap(pos) = i;
+    }
+    mIndex = 0;
   }
 
   double processSample(double val)
   {
     assert(mInitialized);
-    mUnsorted.push_back(val);
-    double old = mUnsorted.front();
-    mUnsorted.pop_front();
-    for (auto it = mSorted.begin(); it != mSorted.end(); ++it)
+    index  p = mPos[asUnsigned(mIndex)];
+    double old = mData[asUnsigned(mIndex)];
+    mData[asUnsigned(mIndex)] = val;
+    mIndex = mIndex + 1 < mFilterSize ? mIndex + 1 : 0;
+    if (p > 0)
     {
-      if ((*it) == old)
-      {
-        it = mSorted.erase(it);
-        break;
-      }
+      if (old < val)
+        minSortDown(p * 2);
+      else if (minSortUp(p))
+        maxSortDown(-1);
+    }
+    else if (p < 0)
+    {
+      if (val < old)
+        maxSortDown(p * 2);
+      else if (maxSortUp(p))
+        minSortDown(1);
     }
-    if (val <= mSorted.front())
-      mSorted.push_front(val);
-    else if (val >= mSorted.back())
-      mSorted.push_back(val);
     else
     {
-      auto it = mSorted.begin();
-      while (*it < val) it++;
-      mSorted.insert(it, val);
+      maxSortDown(-1);
+      minSortDown(1);
+    }
+    return mData[asUnsigned(heap(0))];
+  }
+
+  /// Batch median over a whole block (e.g. a spectral frame), starting from a
+  /// zeroed window: output(i) is the median of the window ending at
+  /// input(i + delay), with zeros past the end of the input
+  void process(const Eigen::Ref<const Eigen::ArrayXd>& input,
+               Eigen::Ref<Eigen::ArrayXd> output, index delay)
+  {
+    assert(output.size() == input.size());
+    reset();
+    index size = input.size();
+    for (index i = 0; i < size + delay; i++)
+    {
+      double median = processSample(i < size ? input(i) : 0);
+      if (i >= delay) output(i - delay) = median;
     }
-    auto it = mSorted.begin();
-    std::advance(it, mMiddle);
-    return *it;
   }
 
   index size() { return mFilterSize; }
@@ -69,12 +115,64 @@ public:
   bool initialized() { return mInitialized; }
 
 private:
+  index& heap(index pos) { return mHeapStorage[asUnsigned(pos + mMiddle)]; }
+
+  bool less(index i, index j)
+  {
+    return mData[asUnsigned(heap(i))] < mData[asUnsigned(heap(j))];
+  }
+
+  bool compareExchange(index i, index j)
+  {
+    if (!less(i, j)) return false;
+    std::swap(heap(i), heap(j));
+    mPos[asUnsigned(heap(i))] = i;
+    mPos[asUnsigned(heap(j))] = j;
+    return true;
+  }
+
+  // restore the min-heap below i / 2
+  void minSortDown(index i)
+  {
+    for (; i <= mMiddle; i *= 2)
+    {
+      if (i > 1 && i < mMiddle && less(i + 1, i)) ++i;
+      if (!compareExchange(i, i / 2)) break;
+    }
+  }
+
+  // restore the max-heap below i / 2
+  void maxSortDown(index i)
+  {
+    for (; i >= -mMiddle; i *= 2)
+    {
+      if (i < -1 && i > -mMiddle && less(i, i - 1)) --i;
+      if (!compareExchange(i / 2, i)) break;
+    }
+  }
+
+  // restore the min-heap above i, returning true if the median changed
+  bool minSortUp(index i)
+  {
+    while (i > 0 && compareExchange(i, i / 2)) i /= 2;
+    return i == 0;
+  }
+
+  // restore the max-heap above i, returning true if the median changed
+  bool maxSortUp(index i)
+  {
+    while (i < 0 && compareExchange(i / 2, i)) i /= 2;
+    return i == 0;
+  }
+
   index mFilterSize{0};
   index mMiddle{0};
+  index mIndex{0};
   bool  mInitialized{false};
 
-  std::deque<double> mUnsorted;
-  std::deque<double> mSorted;
+  std::vector<double> mData;
+  std::vector<index>  mPos;
+  std::vector<index>  mHeapStorage;
 };
 } // namespace algorithm
 } // namespace fluid
@@ -29,13 +29,13 @@ public:
   {
     using namespace Eigen;
     index N = std::max(rows, cols);
-    mCost = ArrayXXd::Zero(N, N);
-    mRowMin = ArrayXd::Zero(N);
-    mColMin = ArrayXd::Zero(N);
-    mMask = ArrayXXi::Zero(N, N);
-    mRowCover = ArrayXi::Zero(N);
-    mColCover = ArrayXi::Zero(N);
-    mPath = ArrayXXi::Zero(2 * N + 1, 2);
+    mCost.setZero(N, N);
+    mRowMin.setZero(N);
+    mColMin.setZero(N);
+    mMask.setZero(N, N);
+    mRowCover.setZero(N);
+    mColCover.setZero(N);
+    mPath.setZero(2 * N + 1, 2);
   }
 
   void reset()
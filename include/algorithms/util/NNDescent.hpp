@@ -0,0 +1,283 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "RandomGenerator.hpp"
+#include "../../data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Approximate k nearest neighbours (Euclidean) of every point, by NN-descent
+// (Dong, Charikar and Li, 2011): starting from neighbours found in the leaves
+// of a few random projection trees, each round compares the neighbours of
+// each point's neighbours (and reverse neighbours) with each other, and stops
+// when hardly any list improves. Only pairs involving a neighbour that is
+// new since the previous round are compared
+class NNDescent
+{
+  using ArrayXXd =
+      Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using ArrayXXi =
+      Eigen::Array<index, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using ArrayXXb =
+      Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using ArrayXi = Eigen::Array<index, Eigen::Dynamic, 1>;
+  using RowVectorXd = Eigen::Array<double, 1, Eigen::Dynamic>;
+
+public:
+  /// A seed >= 0 makes the result reproducible
+  explicit NNDescent(index seed = -1) : mRandom(makeGenerator(seed)) {}
+
+  /// Fills row i of indices and distances with the k neighbours of row i of
+  /// data (itself excluded), nearest first
+  template <typename Data>
+  void process(const Data& data, index k, Eigen::Ref<ArrayXXi> indices,
+               Eigen::Ref<ArrayXXd> distances, index maxIter = 10,
+               double delta = 0.001)
+  {
+    index n = data.rows();
+    assert(k < n);
+    mData = data;
+    mK = k;
+    mIndices = ArrayXXi::Constant(n, k, -1);
+    mDistances =
+        ArrayXXd::Constant(n, k, std::numeric_limits<double>::infinity());
+    mNew = ArrayXXb::Constant(n, k, true);
+    initRandomProjections(std::max<index>(10, k));
+    initRandom();
+    index maxCandidates = std::min<index>(k, 60);
+    mNewCandidates.resize(n, maxCandidates);
+    mOldCandidates.resize(n, maxCandidates);
+    mNumNew.resize(n);
+    mNumOld.resize(n);
+    for (index iter = 0; iter < maxIter; iter++)
+    {
+      buildCandidates();
+      if (localJoin() <= delta * n * k) break;
+    }
+    for (index i = 0; i < n; i++)
+    {
+      mOrder.resize(asUnsigned(k));
+      std::iota(mOrder.begin(), mOrder.end(), 0);
+      std::sort(mOrder.begin(), mOrder.end(), [&](index a, index b) {
+        return mDistances(i, a) < mDistances(i, b);
+      });
+      for (index j = 0; j < k; j++)
+      {
+        indices(i, j) = mIndices(i, mOrder[asUnsigned(j)]);
+        distances(i, j) = std::sqrt(mDistances(i, mOrder[asUnsigned(j)]));
+      }
+    }
+  }
+
+private:
+  double distance(index a, index b) const
+  {
+    return (mData.row(a) - mData.row(b)).square().sum();
+  }
+
+  // offers b as a neighbour of a; each row is a max-heap on (squared)
+  // distance, so the root is the one to replace
+  bool push(index a, index b, double dist)
+  {
+    if (dist >= mDistances(a, 0) || a == b) return false;
+    for (index j = 0; j < mK; j++)
+      if (mIndices(a, j) == b) return false;
+    index j = 0;
+    while (true)
+    {
+      index child = 2 * j + 1;
+      if (child >= mK) break;
+      if (child + 1 < mK && mDistances(a, child + 1) > mDistances(a, child))
+        child++;
+      if (mDistances(a, child) <= dist) break;
+      mIndices(a, j) = mIndices(a, child);
+      mDistances(a, j) = mDistances(a, child);
+      mNew(a, j) = mNew(a, child);
+      j = child;
+    }
+    mIndices(a, j) = b;
+    mDistances(a, j) = dist;
+    mNew(a, j) = true;
+    return true;
+  }
+
+  void pushPair(index a, index b)
+  {
+    double dist = distance(a, b);
+    push(a, b, dist);
+    push(b, a, dist);
+  }
+
+  // every pair of points in each leaf of a few random projection trees
+  void initRandomProjections(index leafSize)
+  {
+    index n = mData.rows();
+    index numTrees = std::min<index>(
+        32, 5 + std::lrint(std::pow(static_cast<double>(n), 0.25)));
+    std::vector<index> points(asUnsigned(n));
+    for (index t = 0; t < numTrees; t++)
+    {
+      std::iota(points.begin(), points.end(), 0);
+      splitNode(points.begin(), points.end(), leafSize);
+    }
+  }
+
+  void splitNode(std::vector<index>::iterator begin,
+                 std::vector<index>::iterator end, index leafSize)
+  {
+    index size = std::distance(begin, end);
+    if (size <= leafSize)
+    {
+      for (auto a = begin; a != end; ++a)
+        for (auto b = a + 1; b != end; ++b) pushPair(*a, *b);
+      return;
+    }
+    // the hyperplane halfway between two random points of the node
+    std::uniform_int_distribution<index> randomPoint(0, size - 1);
+    index                                p = *(begin + randomPoint(mRandom));
+    index                                q = *(begin + randomPoint(mRandom));
+    mNormal = mData.row(p) - mData.row(q);
+    double offset = -(mNormal * (mData.row(p) + mData.row(q))).sum() / 2.0;
+    auto middle = std::partition(begin, end, [&](index i) {
+      return (mNormal * mData.row(i)).sum() + offset > 0;
+    });
+    if (middle == begin || middle == end) // e.g. duplicates: split anywhere
+      middle = begin + size / 2;
+    splitNode(begin, middle, leafSize);
+    splitNode(middle, end, leafSize);
+  }
+
+  // fill any rows that are still short with random points
+  void initRandom()
+  {
+    index                                n = mData.rows();
+    std::uniform_int_distribution<index> randomPoint(0, n - 1);
+    for (index i = 0; i < n; i++)
+    {
+      for (index tries = 0; mIndices(i, 0) < 0 && tries < 4 * mK; tries++)
+      {
+        index j = randomPoint(mRandom);
+        push(i, j, distance(i, j));
+      }
+    }
+  }
+
+  // up to maxCandidates (chosen at random) of each point's new and old
+  // neighbours, and of the points that have it as a neighbour
+  void buildCandidates()
+  {
+    index n = mData.rows();
+    mNumNew.setZero();
+    mNumOld.setZero();
+    mSeenNew.assign(asUnsigned(n), 0);
+    mSeenOld.assign(asUnsigned(n), 0);
+    for (index i = 0; i < n; i++)
+    {
+      for (index j = 0; j < mK; j++)
+      {
+        index neighbour = mIndices(i, j);
+        if (neighbour < 0) continue;
+        if (mNew(i, j))
+        {
+          addCandidate(mNewCandidates, mNumNew, mSeenNew, i, neighbour);
+          addCandidate(mNewCandidates, mNumNew, mSeenNew, neighbour, i);
+        }
+        else
+        {
+          addCandidate(mOldCandidates, mNumOld, mSeenOld, i, neighbour);
+          addCandidate(mOldCandidates, mNumOld, mSeenOld, neighbour, i);
+        }
+      }
+    }
+    // neighbours that made it into a candidate list are no longer new
+    for (index i = 0; i < n; i++)
+    {
+      for (index j = 0; j < mK; j++)
+      {
+        if (!mNew(i, j)) continue;
+        auto candidates = mNewCandidates.row(i).head(mNumNew(i));
+        mNew(i, j) = (candidates != mIndices(i, j)).all();
+      }
+    }
+  }
+
+  // reservoir sampling, so that lists are a uniform sample when they overflow
+  void addCandidate(ArrayXXi& lists, ArrayXi& counts,
+                    std::vector<index>& seen, index i, index candidate)
+  {
+    auto& count = counts(i);
+    auto  listRow = lists.row(i);
+    for (index j = 0; j < count; j++)
+      if (listRow(j) == candidate) return;
+    index s = seen[asUnsigned(i)]++;
+    if (count < lists.cols())
+      listRow(count++) = candidate;
+    else
+    {
+      index slot = std::uniform_int_distribution<index>(0, s)(mRandom);
+      if (slot < lists.cols()) listRow(slot) = candidate;
+    }
+  }
+
+  index localJoin()
+  {
+    index updates = 0;
+    for (index i = 0; i < mData.rows(); i++)
+    {
+      auto newRow = mNewCandidates.row(i).head(mNumNew(i));
+      auto oldRow = mOldCandidates.row(i).head(mNumOld(i));
+      for (index a = 0; a < newRow.size(); a++)
+      {
+        for (index b = a + 1; b < newRow.size(); b++)
+          updates += tryPair(newRow(a), newRow(b));
+        for (index b = 0; b < oldRow.size(); b++)
+          updates += tryPair(newRow(a), oldRow(b));
+      }
+    }
+    return updates;
+  }
+
+  index tryPair(index a, index b)
+  {
+    if (a == b) return 0;
+    double dist = distance(a, b);
+    return static_cast<index>(push(a, b, dist)) +
+           static_cast<index>(push(b, a, dist));
+  }
+
+  index              mK{0};
+  ArrayXXd           mData;
+  ArrayXXi           mIndices;
+  ArrayXXd           mDistances;
+  ArrayXXb           mNew;
+  ArrayXXi           mNewCandidates;
+  ArrayXXi           mOldCandidates;
+  ArrayXi            mNumNew;
+  ArrayXi            mNumOld;
+  std::vector<index> mSeenNew;
+  std::vector<index> mSeenOld;
+  std::vector<index> mOrder;
+  RowVectorXd        mNormal;
+  std::mt19937       mRandom;
+};
+} // namespace algorithm
+} // namespace fluid
@@ -52,6 +52,35 @@ public:
     return _funcs;
   }
 
+  // in place, for inference on arrays of any scalar type
+  template <typename Derived>
+  static void apply(Activation a, Eigen::ArrayBase<Derived>& x)
+  {
+    using Scalar = typename Derived::Scalar;
+    switch (a)
+    {
+    case Activation::kLinear: break;
+    case Activation::kSigmoid: x = Scalar(1) / (Scalar(1) + (-x).exp()); break;
+    case Activation::kReLU: x = x.max(Scalar(0)); break;
+    case Activation::kTanh: x = x.tanh(); break;
+    }
+  }
+
+  // multiplies grad by the derivative, given the output of the activation
+  template <typename Out, typename Grad>
+  static void chain(Activation a, const Eigen::ArrayBase<Out>& out,
+                    Eigen::ArrayBase<Grad>& grad)
+  {
+    using Scalar = typename Grad::Scalar;
+    switch (a)
+    {
+    case Activation::kLinear: break;
+    case Activation::kSigmoid: grad *= out * (Scalar(1) - out); break;
+    case Activation::kReLU: grad *= (out > Scalar(0)).template cast<Scalar>(); break;
+    case Activation::kTanh: grad *= Scalar(1) - out.square(); break;
+    }
+  }
+
   // derivative from output of activation
   static ActivationsMap& derivative()
   {
@@ -11,8 +11,11 @@ under the European Union’s Horizon 2020 research and innovation programme
 #pragma once
 
 #include "NNFuncs.hpp"
+#include "RandomGenerator.hpp"
 #include "../../data/FluidIndex.hpp"
 #include <Eigen/Core>
+#include <cmath>
+#include <random>
 
 namespace fluid {
 namespace algorithm {
@@ -21,10 +24,16 @@ class NNLayer
 {
   using MatrixXd = Eigen::MatrixXd;
   using VectorXd = Eigen::VectorXd;
+  using VectorXf = Eigen::VectorXf;
+  template <typename T>
+  using RowMajorMatrix =
+      Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
   using Activation = NNActivations::Activation;
   using LayerData = std::tuple<RealMatrixView, RealVectorView, index>;
 
 public:
+  enum Optimizer { kSGD, kRMSProp, kAdam };
+
   NNLayer(index inputSize, index outputSize, index actType)
   {
     using namespace Eigen;
@@ -42,14 +51,51 @@ public:
     mActType = actType;
     mActivation = static_cast<Activation>(actType);
     initGrads();
+    prepareInference();
   }
 
-  void init()
+  void init(std::mt19937& gen)
   {
     double dev = std::sqrt(6.0 / (mWeights.rows() + mWeights.cols()));
-    mWeights = dev * MatrixXd::Random(mWeights.rows(), mWeights.cols()).array();
+    mWeights =
+        dev * uniformRandom<MatrixXd>(mWeights.rows(), mWeights.cols(), gen);
     mBiases = VectorXd::Zero(mWeights.cols());
     initGrads();
+    prepareInference();
+  }
+
+  // transposed copies of the parameters, in double and single precision, so
+  // that each output of forwardFrame() is a dot product with a contiguous row
+  void prepareInference()
+  {
+    mInferenceWeights = mWeights.transpose();
+    mInferenceBiases = mBiases;
+    mInferenceWeightsFloat = mInferenceWeights.cast<float>();
+    mInferenceBiasesFloat = mBiases.cast<float>();
+  }
+
+  /// Inference only: neither allocates nor keeps anything for backward().
+  /// Uses the parameters as of the last prepareInference()
+  template <typename T>
+  void forwardFrame(const T* in, T* out) const
+  {
+    using Vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+    Eigen::Map<const Vector> x(in, inputSize());
+    Eigen::Map<Vector>       y(out, outputSize());
+    y = inferenceBiases(T{});
+    y.noalias() += inferenceWeights(T{}) * x;
+    auto activated = y.array();
+    NNActivations::apply(mActivation, activated);
+  }
+
+  /// As forwardFrame(), for a block of frames (one per row) by GEMM
+  void forwardBlock(Eigen::Ref<const RowMajorMatrix<double>> in,
+                    Eigen::Ref<RowMajorMatrix<double>>       out) const
+  {
+    out.noalias() = in * mInferenceWeights.transpose();
+    out.rowwise() += mInferenceBiases.transpose();
+    auto activated = out.array();
+    NNActivations::apply(mActivation, activated);
   }
 
   MatrixXd getWeights() const { return mWeights; }
@@ -62,47 +108,122 @@ public:
     mBiasesGrad = VectorXd::Zero(mWeights.cols());
     mPrevWeightsUpdate = MatrixXd::Zero(mWeights.rows(), mWeights.cols());
     mPrevBiasesUpdate = VectorXd::Zero(mWeights.cols());
+    mWeightsSquares = MatrixXd::Zero(mWeights.rows(), mWeights.cols());
+    mBiasesSquares = VectorXd::Zero(mWeights.cols());
+    mSteps = 0;
   }
 
   index inputSize() const { return mWeights.rows(); }
 
   index outputSize() const { return mWeights.cols(); }
 
-  void forward(Eigen::Ref<MatrixXd> in, Eigen::Ref<MatrixXd> out)
+  // The training passes keep no state, so that several threads can each
+  // work on part of a batch with their own storage (one example per row)
+
+  void forward(Eigen::Ref<const MatrixXd> in, Eigen::Ref<MatrixXd> out) const
+  {
+    out.noalias() = in * mWeights;
+    out.rowwise() += mBiases.transpose();
+    auto activated = out.array();
+    NNActivations::apply(mActivation, activated);
+  }
+
+  // given the gradient of the loss with respect to out (which is overwritten
+  // with that with respect to the activation's input), adds the gradients of
+  // the parameters to weightsGrad and biasesGrad
+  void backward(Eigen::Ref<const MatrixXd> in, Eigen::Ref<const MatrixXd> out,
+                Eigen::Ref<MatrixXd> outGrad, Eigen::Ref<MatrixXd> weightsGrad,
+                Eigen::Ref<VectorXd> biasesGrad) const
+  {
+    auto actGrad = outGrad.array();
+    NNActivations::chain(mActivation, out.array(), actGrad);
+    weightsGrad.noalias() += in.transpose() * outGrad;
+    biasesGrad += outGrad.colwise().sum().transpose();
+  }
+
+  // after backward(), the gradient with respect to the input
+  void backwardInput(Eigen::Ref<const MatrixXd> outGrad,
+                     Eigen::Ref<MatrixXd>       inGrad) const
   {
-    mInput = in;
-    MatrixXd WT = mWeights.transpose();
-    MatrixXd IT = mInput.transpose();
-    MatrixXd Z = ((WT * IT).colwise() + mBiases).transpose();
-    mOutput = MatrixXd::Zero(out.rows(), out.cols());
-    NNActivations::activation()[mActivation](Z, mOutput);
-    out = mOutput;
+    inGrad.noalias() = outGrad * mWeights.transpose();
   }
 
-  void backward(Eigen::Ref<MatrixXd> outGrad, Eigen::Ref<MatrixXd> inGrad)
-  { // going backwards, so out is in
-    MatrixXd dAct = MatrixXd::Zero(mOutput.rows(), mOutput.cols());
-    NNActivations::derivative()[mActivation](mOutput, dAct);
-    MatrixXd actGrad = dAct.array() * outGrad.array();
-    double   norm = 1.0 / mInput.rows();
-    mWeightsGrad = norm * (mInput.transpose() * actGrad);
-    inGrad = actGrad * mWeights.transpose();
-    mBiasesGrad = actGrad.colwise().mean();
+  // the gradients for update(), e.g. sums over a batch scaled by 1 / size
+  void setGradients(const MatrixXd& weightsGrad, const VectorXd& biasesGrad,
+                    double scale)
+  {
+    mWeightsGrad = scale * weightsGrad;
+    mBiasesGrad = scale * biasesGrad;
   }
 
-  void update(double learningRate, double momentum)
+  // SGD with momentum; RMSProp, which scales each step by a running RMS of
+  // the gradient; or Adam, which also averages the gradient itself, with
+  // momentum as its first decay rate
+  void update(double learningRate, double momentum, index optimizer = kSGD)
   {
-    MatrixXd wUpdate = (momentum * mPrevWeightsUpdate) +
-                       ((1 - momentum) * learningRate * mWeightsGrad);
-    VectorXd bUpdate = (momentum * mPrevBiasesUpdate) +
-                       ((1 - momentum) * learningRate * mBiasesGrad);
-    mWeights = mWeights - wUpdate;
-    mBiases = mBiases - bUpdate;
-    mPrevWeightsUpdate = wUpdate;
-    mPrevBiasesUpdate = bUpdate;
+    switch (optimizer)
+    {
+    case kRMSProp:
+      updateRMSProp(mWeights, mWeightsGrad, mWeightsSquares, learningRate);
+      updateRMSProp(mBiases, mBiasesGrad, mBiasesSquares, learningRate);
+      break;
+    case kAdam:
+      mSteps++;
+      updateAdam(mWeights, mWeightsGrad, mPrevWeightsUpdate, mWeightsSquares,
+                 learningRate, momentum);
+      updateAdam(mBiases, mBiasesGrad, mPrevBiasesUpdate, mBiasesSquares,
+                 learningRate, momentum);
+      break;
+    default:
+      mPrevWeightsUpdate = momentum * mPrevWeightsUpdate +
+                           (1 - momentum) * learningRate * mWeightsGrad;
+      mPrevBiasesUpdate = momentum * mPrevBiasesUpdate +
+                          (1 - momentum) * learningRate * mBiasesGrad;
+      mWeights -= mPrevWeightsUpdate;
+      mBiases -= mPrevBiasesUpdate;
+    }
   }
 
 private:
+  template <typename Params>
+  static void updateRMSProp(Params& params, const Params& grad, Params& squares,
+                            double learningRate)
+  {
+    const double decay = 0.9;
+    const double eps = 1e-8;
+    squares.array() =
+        decay * squares.array() + (1 - decay) * grad.array().square();
+    params.array() -=
+        learningRate * grad.array() / (squares.array().sqrt() + eps);
+  }
+
+  // bias-corrected for the number of steps so far
+  template <typename Params>
+  void updateAdam(Params& params, const Params& grad, Params& mean,
+                  Params& squares, double learningRate, double decay) const
+  {
+    const double squaresDecay = 0.999;
+    const double eps = 1e-8;
+    mean.array() = decay * mean.array() + (1 - decay) * grad.array();
+    squares.array() = squaresDecay * squares.array() +
+                      (1 - squaresDecay) * grad.array().square();
+    double meanScale = 1.0 / (1 - std::pow(decay, mSteps));
+    double squaresScale = 1.0 / (1 - std::pow(squaresDecay, mSteps));
+    params.array() -= learningRate * meanScale * mean.array() /
+                      ((squaresScale * squares.array()).sqrt() + eps);
+  }
+
+  const RowMajorMatrix<double>& inferenceWeights(double) const
+  {
+    return mInferenceWeights;
+  }
+  const RowMajorMatrix<float>& inferenceWeights(float) const
+  {
+    return mInferenceWeightsFloat;
+  }
+  const VectorXd& inferenceBiases(double) const { return mInferenceBiases; }
+  const VectorXf& inferenceBiases(float) const { return mInferenceBiasesFloat; }
+
   MatrixXd   mWeights;
   VectorXd   mBiases;
   index      mActType;
@@ -111,11 +232,16 @@ private:
   MatrixXd mWeightsGrad;
   VectorXd mBiasesGrad;
 
-  MatrixXd mPrevWeightsUpdate;
+  MatrixXd mPrevWeightsUpdate; // the mean gradient, for Adam
   VectorXd mPrevBiasesUpdate;
-
-  MatrixXd mInput;
-  MatrixXd mOutput;
+  MatrixXd mWeightsSquares;
+  VectorXd mBiasesSquares;
+  index    mSteps{0};
+
+  RowMajorMatrix<double> mInferenceWeights;
+  VectorXd               mInferenceBiases;
+  RowMajorMatrix<float>  mInferenceWeightsFloat;
+  VectorXf               mInferenceBiasesFloat;
 };
 } // namespace algorithm
 } // namespace fluid
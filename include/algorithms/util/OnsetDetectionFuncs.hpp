@@ -15,7 +15,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include <Eigen/Core>
 #include <cassert>
 #include <cmath>
-#include <map>
+#include <complex>
 
 namespace fluid {
 namespace algorithm {
@@ -39,95 +39,156 @@ public:
 
   using ArrayXcd = Eigen::ArrayXcd;
   using ArrayXd = Eigen::ArrayXd;
-  using ODFMap =
-      std::map<ODF, std::function<double(ArrayXcd, ArrayXcd, ArrayXcd)>>;
 
-  static ArrayXd wrapPhase(ArrayXd phase)
+  // A spectral frame with its magnitude and phase, computed once when the
+  // frame is set so that the following frames can reuse them. The phase is
+  // only computed when asked for, see needsPhase()
+  struct Spectrum
   {
-    return phase.unaryExpr([=](const double p) {
-      return p > (-pi) && p > pi
-                 ? p
-                 : p + (twoPi) * (1.0 + floor((-pi - p) / twoPi));
-    });
+    ArrayXcd frame;
+    ArrayXd  mag;
+    ArrayXd  phase;
+
+    void setZero(index size)
+    {
+      frame.setZero(size);
+      mag.setZero(size);
+      phase.setZero(size);
+    }
+
+    void set(const Eigen::Ref<const ArrayXcd>& input, bool withPhase = true)
+    {
+      frame = input;
+      mag = input.abs().real();
+      if (withPhase) phase = input.atan().real();
+    }
+  };
+
+  using ODFFunction = double (*)(const Spectrum& cur, const Spectrum& prev,
+                                 const Spectrum& prevprev);
+
+  static double wrapPhase(const double p)
+  {
+    return p > (-pi) && p > pi
+               ? p
+               : p + (twoPi) * (1.0 + std::floor((-pi - p) / twoPi));
+  }
+
+  template <typename Derived>
+  static auto wrapPhase(const Eigen::ArrayBase<Derived>& phase)
+  {
+    return phase.unaryExpr([](const double p) { return wrapPhase(p); });
+  }
+
+  // Resolve the function once per parameter change, rather than per frame
+  static ODFFunction select(ODF function)
+  {
+    switch (function)
+    {
+    case ODF::kEnergy: return &energy;
+    case ODF::kHFC: return &hfc;
+    case ODF::kSpectralFlux: return &spectralFlux;
+    case ODF::kMKL: return &mkl;
+    case ODF::kIS: return &itakuraSaito;
+    case ODF::kCosine: return &cosine;
+    case ODF::kPhaseDev: return &phaseDeviation;
+    case ODF::kWPhaseDev: return &weightedPhaseDeviation;
+    case ODF::kComplexDev: return &complexDeviation;
+    case ODF::kRComplexDev: return &rectifiedComplexDeviation;
+    }
+    assert(false && "Unknown onset detection function");
+    return &energy;
+  }
+
+  // Whether the function reads the phase of its spectra, resolved with
+  // select() so that the others can skip computing it
+  static bool needsPhase(ODF function)
+  {
+    return function >= ODF::kPhaseDev && function <= ODF::kRComplexDev;
+  }
+
+  static double energy(const Spectrum& cur, const Spectrum& /*prev*/,
+                       const Spectrum& /*prevprev*/)
+  {
+    return cur.mag.square().mean();
+  }
+
+  static double hfc(const Spectrum& cur, const Spectrum& /*prev*/,
+                    const Spectrum& /*prevprev*/)
+  {
+    index n = cur.mag.size();
+    return (ArrayXd::LinSpaced(n, 0, n) * cur.mag.square()).mean();
+  }
+
+  static double spectralFlux(const Spectrum& cur, const Spectrum& prev,
+                             const Spectrum& /*prevprev*/)
+  {
+    return (cur.mag - prev.mag).max(0.0).mean();
+  }
+
+  static double mkl(const Spectrum& cur, const Spectrum& prev,
+                    const Spectrum& /*prevprev*/)
+  {
+    auto mag1 = cur.mag.max(epsilon);
+    auto mag2 = prev.mag.max(epsilon);
+    return (mag1 / mag2).max(epsilon).log().mean();
+  }
+
+  static double itakuraSaito(const Spectrum& cur, const Spectrum& prev,
+                             const Spectrum& /*prevprev*/)
+  {
+    auto ratio =
+        (cur.mag.max(epsilon) / prev.mag.max(epsilon)).square().max(epsilon);
+    return (ratio - ratio.log() - 1).mean();
+  }
+
+  static double cosine(const Spectrum& cur, const Spectrum& prev,
+                       const Spectrum& /*prevprev*/)
+  {
+    auto   mag1 = cur.mag.max(epsilon).matrix();
+    auto   mag2 = prev.mag.max(epsilon).matrix();
+    double norm = mag1.norm() * mag2.norm();
+    double dot = mag1.dot(mag2);
+    return 1 - dot / norm;
+  }
+
+  static double phaseDeviation(const Spectrum& cur, const Spectrum& prev,
+                               const Spectrum& prevprev)
+  {
+    return wrapPhase((cur.phase - prev.phase) - (prev.phase - prevprev.phase))
+        .mean();
+  }
+
+  static double weightedPhaseDeviation(const Spectrum& cur,
+                                       const Spectrum& prev,
+                                       const Spectrum& prevprev)
+  {
+    return wrapPhase(cur.mag.max(epsilon) * ((cur.phase - prev.phase) -
+                                             (prev.phase - prevprev.phase)))
+        .mean();
+  }
+
+  static double complexDeviation(const Spectrum& cur, const Spectrum& prev,
+                                 const Spectrum& prevprev)
+  {
+    double sum = 0;
+    for (index i = 0; i < cur.frame.size(); i++)
+    {
+      double prevMag = std::max(prev.mag(i), epsilon);
+      double phaseEst =
+          wrapPhase(prev.phase(i) + (prev.phase(i) - prevprev.phase(i)));
+      std::complex<double> target(prevMag * std::cos(phaseEst),
+                                  prevMag * std::sin(phaseEst));
+      sum += std::abs(target - cur.frame(i));
+    }
+    return sum / cur.frame.size();
   }
 
-  static ODFMap& map()
+  static double rectifiedComplexDeviation(const Spectrum& cur,
+                                          const Spectrum& prev,
+                                          const Spectrum& prevprev)
   {
-    static ODFMap _funcs = {
-
-        {ODF::kEnergy,
-         [](ArrayXcd cur, ArrayXcd /*prev*/, ArrayXcd /*prevprev*/) {
-           return cur.abs().real().square().mean();
-         }},
-        {ODF::kHFC,
-         [](ArrayXcd cur, ArrayXcd /*prev*/, ArrayXcd /*prevprev*/) {
-           index   n = cur.size();
-           ArrayXd space = ArrayXd(n);
-           space.setLinSpaced(0, n);
-           return (space * cur.abs().real().square()).mean();
-         }},
-        {ODF::kSpectralFlux,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd /*prevprev*/) {
-           return (cur.abs().real() - prev.abs().real()).max(0.0).mean();
-         }},
-        {ODF::kMKL,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd /*prevprev*/) {
-           ArrayXd mag1 = cur.abs().real().max(epsilon);
-           ArrayXd mag2 = prev.abs().real().max(epsilon);
-           return (mag1 / mag2).max(epsilon).log().mean();
-         }},
-        {ODF::kIS,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd /*prevprev*/) {
-           ArrayXd mag1 = cur.abs().real().max(epsilon);
-           ArrayXd mag2 = prev.abs().real().max(epsilon);
-           ArrayXd ratio = (mag1 / mag2).square().max(epsilon);
-           return (ratio - ratio.log() - 1).mean();
-         }},
-        {ODF::kCosine,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd /*prevprev*/) {
-           ArrayXd mag1 = cur.abs().real().max(epsilon);
-           ArrayXd mag2 = prev.abs().real().max(epsilon);
-           double  norm = mag1.matrix().norm() * mag2.matrix().norm();
-           double  dot = mag1.matrix().dot(mag2.matrix());
-           return 1 - dot / norm;
-         }},
-        {ODF::kPhaseDev,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd prevprev) {
-           ArrayXd phaseAcc = (cur.atan().real() - prev.atan().real()) -
-                              (prev.atan().real() - prevprev.atan().real());
-           return wrapPhase(phaseAcc).mean();
-         }},
-        {ODF::kWPhaseDev,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd prevprev) {
-           ArrayXd mag1 = cur.abs().real().max(epsilon);
-           ArrayXd phaseAcc = (cur.atan().real() - prev.atan().real()) -
-                              (prev.atan().real() - prevprev.atan().real());
-           return wrapPhase(mag1 * phaseAcc).mean();
-         }},
-        {ODF::kComplexDev,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd prevprev) {
-           ArrayXcd target(cur.size());
-           ArrayXd  prevMag = prev.abs().real().max(epsilon);
-           ArrayXd  prevPhase = prev.atan().real();
-           ArrayXd  phaseEst = wrapPhase(
-               prevPhase + (prev.atan().real() - prevprev.atan().real()));
-           target.real() = prevMag * phaseEst.cos();
-           target.imag() = prevMag * phaseEst.sin();
-           return (target - cur).abs().real().mean();
-         }},
-        {ODF::kRComplexDev,
-         [](ArrayXcd cur, ArrayXcd prev, ArrayXcd prevprev) {
-           ArrayXcd target(cur.size());
-           ArrayXd  prevMag = prev.abs().real().max(epsilon);
-           ArrayXd  prevPhase = prev.atan().real();
-           ArrayXd  phaseEst = wrapPhase(
-               prevPhase + (prev.atan().real() - prevprev.atan().real()));
-           target.real() = prevMag * phaseEst.cos();
-           target.imag() = prevMag * phaseEst.sin();
-           return (target - cur).abs().real().max(0.0).mean();
-         }},
-    };
-    return _funcs;
+    return std::max(complexDeviation(cur, prev, prevprev), 0.0);
   }
 };
 } // namespace algorithm
@@ -0,0 +1,144 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "../../data/FluidIndex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+inline index hardwareThreads()
+{
+  return std::max<index>(asSigned(std::thread::hardware_concurrency()), 1);
+}
+
+/// Call func(i) for each i in [0, n), sharing the indices between up to
+/// maxThreads threads (the calling one included). Indices are handed out one
+/// at a time as threads become free, so items of uneven cost are balanced;
+/// func must be safe to call concurrently for different i
+template <typename Func>
+void parallelFor(index n, Func&& func, index maxThreads = hardwareThreads())
+{
+  index nThreads = std::min(maxThreads, n);
+  if (nThreads < 2)
+  {
+    for (index i = 0; i < n; i++) func(i);
+    return;
+  }
+  std::atomic<index> next{0};
+  auto               worker = [&]() {
+    for (index i = next++; i < n; i = next++) func(i);
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(asUnsigned(nThreads - 1));
+  for (index t = 1; t < nThreads; t++) threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads) t.join();
+}
+
+/// A fixed set of threads that run parallelFor loops, for callers that would
+/// otherwise start and join threads many times over (once per training batch,
+/// say). The calling thread takes part in each loop, so a pool of size 1 runs
+/// them inline. Loops are run one at a time: forEach must not be called
+/// concurrently on the same pool, nor from inside one of its loops
+class ThreadPool
+{
+public:
+  explicit ThreadPool(index size = hardwareThreads())
+  {
+    for (index t = 1; t < size; t++) mWorkers.emplace_back([this] { work(); });
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+    mWake.notify_all();
+    for (auto& t : mWorkers) t.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  index size() const { return asSigned(mWorkers.size()) + 1; }
+
+  /// As parallelFor(n, func), on the pool's threads
+  template <typename Func>
+  void forEach(index n, Func&& func)
+  {
+    using F = std::remove_reference_t<Func>;
+    if (mWorkers.empty() || n < 2)
+    {
+      for (index i = 0; i < n; i++) func(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mTask = [](void* f, index i) { (*static_cast<F*>(f))(i); };
+      mContext = const_cast<void*>(static_cast<const void*>(&func));
+      mCount = n;
+      mNext = 0;
+      mBusy = asSigned(mWorkers.size());
+      mGeneration++;
+    }
+    mWake.notify_all();
+    run();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mBusy == 0; });
+  }
+
+private:
+  void work()
+  {
+    index seen = 0;
+    for (;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWake.wait(lock, [&] { return mStop || mGeneration != seen; });
+        if (mStop) return;
+        seen = mGeneration;
+      }
+      run();
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (--mBusy == 0) mDone.notify_one();
+    }
+  }
+
+  void run()
+  {
+    for (index i = mNext++; i < mCount; i = mNext++) mTask(mContext, i);
+  }
+
+  std::vector<std::thread> mWorkers;
+  std::mutex               mMutex;
+  std::condition_variable  mWake;
+  std::condition_variable  mDone;
+  void (*mTask)(void*, index){nullptr};
+  void*              mContext{nullptr};
+  index              mCount{0};
+  std::atomic<index> mNext{0};
+  index              mBusy{0};
+  index              mGeneration{0};
+  bool               mStop{false};
+};
+
+} // namespace algorithm
+} // namespace fluid
@@ -15,11 +15,14 @@ Capability through Linear Programming". Proceedings of DAFx-2018.
 
 #pragma once
 
-#include "Munkres.hpp"
+#include "PeakAssignment.hpp"
 #include "../../data/FluidIndex.hpp"
 #include <Eigen/Core>
+#include <algorithm>
 #include <cmath>
-#include <queue>
+#include <numeric>
+#include <tuple>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -45,6 +48,8 @@ struct SineTrack
 class PartialTracking
 {
   using ArrayXd = Eigen::ArrayXd;
+  using ArrayXi = Eigen::ArrayXi;
+  using ArrayXb = Eigen::Array<bool, Eigen::Dynamic, 1>;
   template <typename T>
   using vector = std::vector<T>;
 
@@ -67,9 +72,10 @@ public:
 
   index minTrackLength() { return mMinTrackLength; }
 
-  void processFrame(vector<SinePeak> peaks, double maxAmp, index minTrackLength,
-                    double birthLowThreshold, double birthHighThreshold,
-                    index method, double zetaA, double zetaF, double delta)
+  void processFrame(vector<SinePeak>& peaks, double maxAmp,
+                    index minTrackLength, double birthLowThreshold,
+                    double birthHighThreshold, index method, double zetaA,
+                    double zetaF, double delta)
   {
     assert(mInitialized);
     mMinTrackLength = minTrackLength;
@@ -101,10 +107,11 @@ public:
   }
 
 
-  vector<SinePeak> getActivePeaks()
+  const vector<SinePeak>& getActivePeaks()
   {
-    vector<SinePeak> sinePeaks;
-    index            latencyFrame = mCurrentFrame - mMinTrackLength;
+    vector<SinePeak>& sinePeaks = mActivePeaks;
+    sinePeaks.clear();
+    index latencyFrame = mCurrentFrame - mMinTrackLength;
     if (latencyFrame < 0) return sinePeaks;
     for (auto&& track : mTracks)
     {
@@ -127,12 +134,10 @@ private:
     mVarF = -pow(mZetaF, 2) * log((mDelta - 1) / (mDelta - 2));
   }
 
-  void assignMunkres(vector<SinePeak> sinePeaks, double maxAmp)
+  void assignMunkres(vector<SinePeak>& sinePeaks, double maxAmp)
   {
-    using namespace Eigen;
     using namespace std;
 
-    typedef Array<bool, Dynamic, Dynamic> ArrayXXb;
     for (auto&& track : mTracks) { track.assigned = false; }
 
     if (mPrevPeaks.empty())
@@ -144,62 +149,20 @@ private:
 
     index         N = asSigned(mPrevPeaks.size());
     index         M = asSigned(sinePeaks.size());
-    ArrayXd       peakFreqs(M);
-    ArrayXd       peakAmps(M);
-    ArrayXd       prevFreqs(N);
-    ArrayXd       prevAmps(N);
     vector<index> trackAssignment(asUnsigned(M), -1);
     if (sinePeaks.size() > 0)
     {
-      for (index i = 0; i < M; i++)
-      {
-        peakFreqs(i) = sinePeaks[asUnsigned(i)].freq;
-        peakAmps(i) = sinePeaks[asUnsigned(i)].logMag;
-      }
-      for (index i = 0; i < N; i++)
-      {
-        prevFreqs(i) = mPrevPeaks[asUnsigned(i)].freq;
-        prevAmps(i) = mPrevPeaks[asUnsigned(i)].logMag;
-      }
-      ArrayXXd deltaF = ArrayXXd::Zero(N, M);
-      deltaF.colwise() = prevFreqs;
-      for (index i = 0; i < N; i++) { deltaF.row(i) -= peakFreqs; }
-      ArrayXXd deltaA = ArrayXXd::Zero(N, M);
-      deltaA.colwise() = prevAmps;
-      for (index i = 0; i < N; i++) { deltaA.row(i) -= peakAmps; }
-
-      ArrayXXd usefulCost =
-          1 - (-deltaF.square() / mVarF - deltaA.square() / mVarA).exp();
-      ArrayXXd spuriousCost = 1 - (1 - mDelta) * usefulCost;
-      ArrayXXd cost(N, M);
-      ArrayXXb useful(N, M);
-      for (index i = 0; i < N; i++)
-      {
-        for (index j = 0; j < M; j++)
-        {
-          if (usefulCost(i, j) < spuriousCost(i, j))
-          {
-            cost(i, j) = std::abs(usefulCost(i, j));
-            useful(i, j) = true;
-          }
-          else
-          {
-            cost(i, j) = spuriousCost(i, j);
-            useful(i, j) = false;
-          }
-        }
-      }
-      ArrayXi assignment(N);
-      mMunkres.init(N, M);
-      mMunkres.process(cost, assignment);
+      mAssignment.resize(N);
+      mUsefulAssignment.resize(N);
+      assignPairs(sinePeaks);
       for (index i = 0; i < N; i++)
       {
-        index p = assignment(i);
+        index p = mAssignment(i);
         bool  aboveBirthThreshold =
             mPrevPeaks[asUnsigned(i)].logMag >
             birthThreshold(mPrevPeaks[asUnsigned(i)], mPrevMaxAmp);
-        if (assignment(i) >= useful.cols()) continue;
-        if (useful(i, assignment(i)) && mPrevTracks[asUnsigned(i)] > 0 &&
+        if (p < 0) continue;
+        if (mUsefulAssignment(i) && mPrevTracks[asUnsigned(i)] > 0 &&
             mPrevPeaks[asUnsigned(i)].assigned)
         {
           for (auto& t : mTracks)
@@ -213,7 +176,7 @@ private:
             }
           }
         }
-        else if (aboveBirthThreshold && useful(i, assignment(i)) &&
+        else if (aboveBirthThreshold && mUsefulAssignment(i) &&
                  !mPrevPeaks[asUnsigned(i)].assigned)
         {
           mLastTrackId = mLastTrackId + 1;
@@ -244,25 +207,77 @@ private:
     mPrevMaxAmp = maxAmp;
   }
 
+  // A pair is only useful if its cost 1 - exp(-dF^2 / varF - dA^2 / varA) is
+  // below 1 / (2 - delta), which bounds the frequency difference on its own
+  double maxFrequencyDeviation()
+  {
+    return std::sqrt(mVarF * std::log((2 - mDelta) / (1 - mDelta)));
+  }
+
+  void sortByFrequency(const vector<SinePeak>& peaks, vector<index>& order)
+  {
+    order.resize(peaks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](index i, index j) {
+      double fi = peaks[asUnsigned(i)].freq, fj = peaks[asUnsigned(j)].freq;
+      return fi < fj || (fi == fj && i < j);
+    });
+  }
+
+  void assignPairs(const vector<SinePeak>& sinePeaks)
+  {
+    index N = asSigned(mPrevPeaks.size());
+    index M = asSigned(sinePeaks.size());
+    mPeakFreqs.resize(M);
+    mPeakAmps.resize(M);
+    mPrevFreqs.resize(N);
+    mPrevAmps.resize(N);
+    for (index i = 0; i < M; i++)
+    {
+      mPeakFreqs(i) = sinePeaks[asUnsigned(i)].freq;
+      mPeakAmps(i) = sinePeaks[asUnsigned(i)].logMag;
+    }
+    for (index i = 0; i < N; i++)
+    {
+      mPrevFreqs(i) = mPrevPeaks[asUnsigned(i)].freq;
+      mPrevAmps(i) = mPrevPeaks[asUnsigned(i)].logMag;
+    }
+    mPeakAssignment.process(mPrevFreqs, mPrevAmps, mPeakFreqs, mPeakAmps,
+                            mVarF, mVarA, mDelta, mAssignment,
+                            mUsefulAssignment);
+  }
+
   double birthThreshold(SinePeak peak, double maxAmp)
   {
     return maxAmp + mBirthLowThreshold - mBirthRange +
            mBirthRange * std::pow(0.0075, peak.freq / 20000.0);
   }
 
-  void assignGreedy(vector<SinePeak> sinePeaks, double maxAmp)
+  void assignGreedy(vector<SinePeak>& sinePeaks, double maxAmp)
   {
     using namespace std;
-    vector<tuple<double, SineTrack*, SinePeak*>> distances;
+    auto& distances = mDistances;
+    distances.clear();
     for (auto&& track : mTracks) { track.assigned = false; }
+    sortByFrequency(sinePeaks, mPeakOrder);
+    double maxDeviation = maxFrequencyDeviation();
     for (auto& track : mTracks)
     {
       if (track.active)
       {
-        for (auto&& peak : sinePeaks)
+        // only peaks within maxDeviation of the track can be useful matches
+        double freq = track.peaks.back().freq;
+        auto   first = lower_bound(
+            mPeakOrder.begin(), mPeakOrder.end(), freq - maxDeviation,
+            [&](index i, double f) {
+              return sinePeaks[asUnsigned(i)].freq < f;
+            });
+        for (auto it = first; it != mPeakOrder.end(); ++it)
         {
+          SinePeak& peak = sinePeaks[asUnsigned(*it)];
+          if (peak.freq > freq + maxDeviation) break;
           double dist =
-              1 - exp(-pow(track.peaks.back().freq - peak.freq, 2) / mVarF -
+              1 - exp(-pow(freq - peak.freq, 2) / mVarF -
                       pow(track.peaks.back().logMag - peak.logMag, 2) / mVarA);
           distances.push_back(std::make_tuple(dist, &track, &peak));
         }
@@ -315,8 +330,17 @@ private:
   vector<SineTrack> mTracks;
   bool              mInitialized{false};
   vector<SinePeak>  mPrevPeaks;
+  vector<SinePeak>  mActivePeaks;
   vector<index>     mPrevTracks;
-  Munkres           mMunkres;
+  PeakAssignment    mPeakAssignment;
+  vector<index>     mPeakOrder;
+  ArrayXd           mPeakFreqs;
+  ArrayXd           mPeakAmps;
+  ArrayXd           mPrevFreqs;
+  ArrayXd           mPrevAmps;
+  ArrayXi           mAssignment;
+  ArrayXb           mUsefulAssignment;
+  vector<std::tuple<double, SineTrack*, SinePeak*>> mDistances;
   double            mZetaA{0};
   double            mVarA{0};
   double            mZetaF{0};
@@ -0,0 +1,183 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/* Costs from
+Neri, J., and Depalle, P., "Fast Partial Tracking of Audio with Real-Time
+Capability through Linear Programming". Proceedings of DAFx-2018.
+*/
+
+#pragma once
+
+#include "SparseAssignment.hpp"
+#include "../../data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Pairs the peaks of two frames at the least total cost, where a pair costs
+// either u = 1 - exp(-dF^2 / varF - dA^2 / varA) if it is useful, or
+// 1 - (1 - delta) * u if it is spurious, whichever is lower, and every peak of
+// the smaller frame takes a partner. This is the problem Munkres solves on the
+// full cost matrix, padded to a square one.
+// Useful pairs are within maxFrequencyDeviation() of each other, and spurious
+// ones cost more than delta. So only pairs within that frequency band are
+// given to a sparse solver; its potentials then tell which rows could do
+// better with a more distant partner, only those rows are checked against
+// the rest of the frame, and any pair found is added before solving again.
+// The result has the same total cost as the dense solution
+class PeakAssignment
+{
+  using ArrayXd = Eigen::ArrayXd;
+  using ArrayXi = Eigen::ArrayXi;
+  using ArrayXb = Eigen::Array<bool, Eigen::Dynamic, 1>;
+  template <typename T>
+  using vector = std::vector<T>;
+
+public:
+  // assignment(i) is the peak paired with previous peak i, or -1, and
+  // useful(i) whether that pair is a useful one
+  void process(const ArrayXd& prevFreqs, const ArrayXd& prevAmps,
+               const ArrayXd& freqs, const ArrayXd& amps, double varF,
+               double varA, double delta, Eigen::Ref<ArrayXi> assignment,
+               Eigen::Ref<ArrayXb> useful)
+  {
+    assignment.setConstant(-1);
+    useful.setConstant(false);
+    if (prevFreqs.size() == 0 || freqs.size() == 0) return;
+    mVarF = varF;
+    mVarA = varA;
+    mDelta = delta;
+    // rows are the smaller frame, so that they are all assigned
+    mTransposed = prevFreqs.size() > freqs.size();
+    mRowFreqs = mTransposed ? &freqs : &prevFreqs;
+    mRowAmps = mTransposed ? &amps : &prevAmps;
+    mColFreqs = mTransposed ? &prevFreqs : &freqs;
+    mColAmps = mTransposed ? &prevAmps : &amps;
+    index rows = mRowFreqs->size(), cols = mColFreqs->size();
+
+    mColOrder.resize(asUnsigned(cols));
+    std::iota(mColOrder.begin(), mColOrder.end(), 0);
+    std::sort(mColOrder.begin(), mColOrder.end(), [&](index i, index j) {
+      return (*mColFreqs)(i) < (*mColFreqs)(j);
+    });
+    double maxDeviation =
+        std::sqrt(varF * std::log((2 - delta) / (1 - delta)));
+    mBandBegin.resize(asUnsigned(rows));
+    mBandEnd.resize(asUnsigned(rows));
+    mComplete.assign(asUnsigned(rows), false);
+    mSolver.init(rows, cols);
+    for (index i = 0; i < rows; i++)
+    {
+      double freq = (*mRowFreqs)(i);
+      auto   first = std::lower_bound(
+          mColOrder.begin(), mColOrder.end(), freq - maxDeviation,
+          [&](index j, double f) { return (*mColFreqs)(j) < f; });
+      auto last = std::upper_bound(
+          first, mColOrder.end(), freq + maxDeviation,
+          [&](double f, index j) { return f < (*mColFreqs)(j); });
+      mBandBegin[asUnsigned(i)] = first - mColOrder.begin();
+      mBandEnd[asUnsigned(i)] = last - mColOrder.begin();
+      for (auto it = first; it != last; ++it)
+        mSolver.addEdge(i, *it, cost(i, *it));
+    }
+
+    for (bool optimal = false; !optimal;)
+    {
+      mSolver.reset();
+      for (index i = 0; i < rows; i++)
+      {
+        // some free column is always within reach of a complete row
+        while (!mSolver.assignRow(i))
+        {
+          assert(!mComplete[asUnsigned(i)]);
+          forEachOutsideBand(i, [&](index j) {
+            mSolver.addEdge(i, j, cost(i, j));
+          });
+          mComplete[asUnsigned(i)] = true;
+        }
+      }
+      double maxColPotential = mSolver.colPotential(0);
+      for (index j = 1; j < cols; j++)
+        maxColPotential = std::max(maxColPotential, mSolver.colPotential(j));
+      optimal = true;
+      for (index i = 0; i < rows; i++)
+      {
+        double potential = mSolver.rowPotential(i);
+        if (mComplete[asUnsigned(i)] || potential + maxColPotential <= delta)
+          continue;
+        forEachOutsideBand(i, [&](index j) {
+          double c = cost(i, j);
+          if (c < potential + mSolver.colPotential(j) - 1e-12)
+          {
+            mSolver.addEdge(i, j, c);
+            optimal = false;
+          }
+        });
+      }
+    }
+
+    for (index i = 0; i < rows; i++)
+    {
+      index j = mSolver.rowAssignment(i);
+      index prev = mTransposed ? j : i;
+      assignment(prev) = static_cast<int>(mTransposed ? i : j);
+      useful(prev) = usefulCost(i, j) < spuriousCost(i, j);
+    }
+  }
+
+private:
+  double usefulCost(index i, index j) const
+  {
+    double dF = (*mRowFreqs)(i) - (*mColFreqs)(j);
+    double dA = (*mRowAmps)(i) - (*mColAmps)(j);
+    return 1 - std::exp(-(dF * dF) / mVarF - dA * dA / mVarA);
+  }
+
+  double spuriousCost(index i, index j) const
+  {
+    return 1 - (1 - mDelta) * usefulCost(i, j);
+  }
+
+  double cost(index i, index j) const
+  {
+    double useful = usefulCost(i, j);
+    return std::min(std::abs(useful), 1 - (1 - mDelta) * useful);
+  }
+
+  template <typename Func>
+  void forEachOutsideBand(index row, Func&& func)
+  {
+    index first = mBandBegin[asUnsigned(row)], last = mBandEnd[asUnsigned(row)];
+    for (index k = 0; k < first; k++) func(mColOrder[asUnsigned(k)]);
+    for (index k = last; k < asSigned(mColOrder.size()); k++)
+      func(mColOrder[asUnsigned(k)]);
+  }
+
+  SparseAssignment mSolver;
+  const ArrayXd*   mRowFreqs{nullptr};
+  const ArrayXd*   mRowAmps{nullptr};
+  const ArrayXd*   mColFreqs{nullptr};
+  const ArrayXd*   mColAmps{nullptr};
+  bool             mTransposed{false};
+  double           mVarF{0};
+  double           mVarA{0};
+  double           mDelta{0};
+  vector<index>    mColOrder;
+  vector<index>    mBandBegin;
+  vector<index>    mBandEnd;
+  vector<bool>     mComplete;
+};
+} // namespace algorithm
+} // namespace fluid
@@ -0,0 +1,50 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "../../data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <random>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+/// A generator seeded with seed, or from std::random_device when seed < 0
+inline std::mt19937 makeGenerator(index seed)
+{
+  if (seed < 0) return std::mt19937{std::random_device()()};
+  return std::mt19937{static_cast<std::mt19937::result_type>(seed)};
+}
+
+/// One generator per thread (or chunk of work), each seeded from gen, so that
+/// parallel code draws the same streams for the same seed
+inline std::vector<std::mt19937> makeGenerators(index count, std::mt19937& gen)
+{
+  std::vector<std::mt19937> generators;
+  generators.reserve(asUnsigned(count));
+  for (index i = 0; i < count; i++) generators.emplace_back(gen());
+  return generators;
+}
+
+/// Uniform values in [-1, 1], as Eigen's Random() but drawn from gen
+template <typename T>
+T uniformRandom(index rows, index cols, std::mt19937& gen)
+{
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  T                                      result(rows, cols);
+  for (index j = 0; j < cols; j++)
+    for (index i = 0; i < rows; i++) result(i, j) = uniform(gen);
+  return result;
+}
+
+} // namespace algorithm
+} // namespace fluid
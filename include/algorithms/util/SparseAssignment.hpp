@@ -0,0 +1,210 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/* Shortest augmenting paths for sparse assignment problems, as in
+Jonker, R., and Volgenant, A., "A Shortest Augmenting Path Algorithm for Dense
+and Sparse Linear Assignment Problems". Computing 38, 1987.
+*/
+
+#pragma once
+
+#include "../../data/FluidIndex.hpp"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// Assigns each row to a distinct column, at minimum total cost, using only
+// the (row, column) pairs given with addEdge. There must be no more rows than
+// columns. Rows are added one at a time, each along a shortest path of
+// reduced costs, so that afterwards rowPotential(i) + colPotential(j) is at
+// most the cost of every edge, equal for assigned ones, and colPotential is 0
+// for unassigned columns and negative or 0 for the rest: a pair that is not
+// an edge can only lower the total cost if it costs less than the sum of its
+// potentials
+class SparseAssignment
+{
+  template <typename T>
+  using vector = std::vector<T>;
+  using Edge = std::pair<index, double>;
+  using Entry = std::pair<double, index>;
+
+public:
+  void init(index rows, index cols)
+  {
+    assert(rows <= cols);
+    mEdges.resize(asUnsigned(rows));
+    for (auto& edges : mEdges) edges.clear();
+    mSorted.assign(asUnsigned(rows), true);
+    mRowPotential.resize(asUnsigned(rows));
+    mRowAssignment.resize(asUnsigned(rows));
+    mColPotential.resize(asUnsigned(cols));
+    mColAssignment.resize(asUnsigned(cols));
+    mPredecessor.resize(asUnsigned(cols));
+    mDist.assign(asUnsigned(cols), infinity());
+    mDone.assign(asUnsigned(cols), false);
+    reset();
+  }
+
+  void addEdge(index row, index col, double cost)
+  {
+    mEdges[asUnsigned(row)].emplace_back(col, cost);
+    mSorted[asUnsigned(row)] = false;
+  }
+
+  // forgets the assignment, but not the edges
+  void reset()
+  {
+    std::fill(mRowPotential.begin(), mRowPotential.end(), 0);
+    std::fill(mRowAssignment.begin(), mRowAssignment.end(), -1);
+    std::fill(mColPotential.begin(), mColPotential.end(), 0);
+    std::fill(mColAssignment.begin(), mColAssignment.end(), -1);
+  }
+
+  // Adds row to the assignment, reassigning others along the way; false if
+  // no free column can be reached from it through the edges
+  bool assignRow(index row)
+  {
+    auto& edges = mEdges[asUnsigned(row)];
+    if (edges.empty()) return false;
+    double& potential = mRowPotential[asUnsigned(row)];
+    potential = infinity();
+    for (auto& e : edges)
+      potential = std::min(potential, e.second - colPotential(e.first));
+
+    mHeap.clear();
+    mVisited.clear();
+    mBound = infinity();
+    relax(row, 0);
+    index  sink = -1;
+    double length = 0;
+    while (!mHeap.empty())
+    {
+      std::pop_heap(mHeap.begin(), mHeap.end(), std::greater<Entry>());
+      double dist = mHeap.back().first;
+      index  col = mHeap.back().second;
+      mHeap.pop_back();
+      if (mDone[asUnsigned(col)] || dist > mDist[asUnsigned(col)]) continue;
+      mDone[asUnsigned(col)] = true;
+      mFinished.push_back(col);
+      if (mColAssignment[asUnsigned(col)] < 0)
+      {
+        sink = col;
+        length = dist;
+        break;
+      }
+      relax(mColAssignment[asUnsigned(col)], dist);
+    }
+
+    if (sink >= 0)
+    {
+      // shifting the potentials of everything closer than the sink keeps
+      // reduced costs non-negative, and zero along the path
+      potential += length;
+      for (index col : mFinished)
+      {
+        double shift = length - mDist[asUnsigned(col)];
+        mColPotential[asUnsigned(col)] -= shift;
+        if (col != sink)
+          mRowPotential[asUnsigned(mColAssignment[asUnsigned(col)])] += shift;
+      }
+      for (index col = sink;;)
+      {
+        index from = mPredecessor[asUnsigned(col)];
+        index next = mRowAssignment[asUnsigned(from)];
+        mRowAssignment[asUnsigned(from)] = col;
+        mColAssignment[asUnsigned(col)] = from;
+        if (from == row) break;
+        col = next;
+      }
+    }
+
+    for (index col : mVisited)
+    {
+      mDist[asUnsigned(col)] = infinity();
+      mDone[asUnsigned(col)] = false;
+    }
+    mFinished.clear();
+    return sink >= 0;
+  }
+
+  const vector<Edge>& edges(index row) const
+  {
+    return mEdges[asUnsigned(row)];
+  }
+  index rowAssignment(index row) const
+  {
+    return mRowAssignment[asUnsigned(row)];
+  }
+  double rowPotential(index row) const
+  {
+    return mRowPotential[asUnsigned(row)];
+  }
+  double colPotential(index col) const
+  {
+    return mColPotential[asUnsigned(col)];
+  }
+
+private:
+  static double infinity() { return std::numeric_limits<double>::infinity(); }
+
+  // Edges are kept in order of cost: as column potentials are never positive,
+  // the rest of them cannot lead anywhere shorter than the closest free column
+  // found so far once the cost alone is too high
+  void relax(index row, double dist)
+  {
+    auto& edges = mEdges[asUnsigned(row)];
+    if (!mSorted[asUnsigned(row)])
+    {
+      std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return a.second < b.second;
+      });
+      mSorted[asUnsigned(row)] = true;
+    }
+    double potential = mRowPotential[asUnsigned(row)];
+    for (auto& e : edges)
+    {
+      if (dist + e.second - potential >= mBound) break;
+      index col = e.first;
+      if (mDone[asUnsigned(col)]) continue;
+      double d = dist + e.second - potential - colPotential(col);
+      if (d < mDist[asUnsigned(col)])
+      {
+        if (mDist[asUnsigned(col)] == infinity()) mVisited.push_back(col);
+        if (mColAssignment[asUnsigned(col)] < 0) mBound = std::min(mBound, d);
+        mDist[asUnsigned(col)] = d;
+        mPredecessor[asUnsigned(col)] = row;
+        mHeap.emplace_back(d, col);
+        std::push_heap(mHeap.begin(), mHeap.end(), std::greater<Entry>());
+      }
+    }
+  }
+
+  vector<vector<Edge>> mEdges;
+  vector<bool>         mSorted;
+  vector<double>       mRowPotential;
+  vector<index>        mRowAssignment;
+  vector<double>       mColPotential;
+  vector<index>        mColAssignment;
+  vector<index>        mPredecessor;
+  vector<double>       mDist;
+  vector<bool>         mDone;
+  vector<index>        mVisited;
+  vector<index>        mFinished;
+  vector<Entry>        mHeap;
+  double               mBound;
+};
+} // namespace algorithm
+} // namespace fluid
@@ -10,12 +10,15 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #pragma once
 
+#include "AlgorithmUtils.hpp"
 #include "FFT.hpp"
 #include "FluidEigenMappings.hpp"
 #include "../../data/FluidIndex.hpp"
 #include "../../data/TensorTypes.hpp"
 #include <Eigen/Eigen>
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 namespace fluid {
 namespace algorithm {
@@ -24,11 +27,19 @@ class TruePeak
 {
 
   using ArrayXcd = Eigen::ArrayXcd;
+  using ArrayXd = Eigen::ArrayXd;
+  using ArrayXXd = Eigen::ArrayXXd;
 
 public:
-  TruePeak(index maxSize) : mFFT(maxSize), mIFFT(maxSize * 4) {}
+  enum TruePeakMethod { kPolyphase, kFFT };
 
-  void init(index size, double sampleRate)
+  TruePeak(index maxSize)
+      : mFFT(maxSize), mIFFT(maxSize * 4), mInterpolated(maxSize)
+  {}
+
+  // frames start hopSize apart in a stream, so that the samples before each
+  // one are known from the frames before it
+  void init(index size, double sampleRate, index hopSize)
   {
     using namespace std;
     mSampleRate = sampleRate;
@@ -37,33 +48,121 @@ public:
     mFFT.resize(mFFTSize);
     mIFFT.resize(mFFTSize * mFactor);
     mBuffer = ArrayXcd::Zero((mFFTSize * mFactor / 2) + 1);
+    initPhases();
+    mHopSize = hopSize;
+    mHistorySize = mPhaseTaps - 1;
+    mHistory = 0;
+    mStream = ArrayXd::Zero(mHistorySize + size);
   }
 
-  double processFrame(const RealVectorView& input)
+  double processFrame(const RealVectorView& input,
+                      index method = kPolyphase)
   {
     using namespace Eigen;
-    ArrayXd in = _impl::asEigen<Array>(input);
-    if (mSampleRate >= 192000) { return in.abs().maxCoeff(); }
+    if (mSampleRate >= 192000)
+    { return _impl::asEigen<Array>(input).abs().maxCoeff(); }
+    return method == kFFT ? processFFT(input) : processPolyphase(input);
+  }
+
+private:
+  // Windowed-sinc interpolation filter, as in libebur128 (49 taps, Hann
+  // window), split into one set of coefficients per output phase
+  void initPhases()
+  {
+    using namespace std;
+    const index taps = 49;
+    const index centre = (taps - 1) / 2;
+    mPhaseTaps = taps / mFactor + 1;
+    mPhases = ArrayXXd::Zero(mFactor, mPhaseTaps);
+    mPhaseStart.resize(asUnsigned(mFactor));
+    for (index p = 0; p < mFactor; p++)
+    {
+      // input sample n - d contributes to output n + p / mFactor through tap
+      // centre + d * mFactor + p
+      index first = -((centre + p) / mFactor);
+      mPhaseStart[asUnsigned(p)] = first;
+      for (index k = 0; k < mPhaseTaps; k++)
+      {
+        index j = centre + (first + k) * mFactor + p;
+        if (j < 0 || j >= taps) continue;
+        double m = static_cast<double>(j - centre);
+        double c = m == 0 ? 1.0 : sin(m * pi / mFactor) / (m * pi / mFactor);
+        c *= 0.5 * (1 - cos(twoPi * j / (taps - 1)));
+        mPhases(p, k) = c;
+      }
+    }
+  }
+
+  // Time-domain oversampling: phase 0 of the filter reproduces the input, so
+  // only the intermediate phases are computed. The mPhaseTaps - 1 samples
+  // before the frame are kept from earlier ones, so that each phase starts
+  // where the last frame's ran out of support: outputs are delayed by the
+  // filter, but in a contiguous stream every one of them is evaluated
+  double processPolyphase(const RealVectorView& input)
+  {
+    auto  in = _impl::asEigen<Eigen::Array>(input).col(0);
+    index size = in.size();
+    index history = mHistory;
+    mStream.segment(mHistorySize, size) = in;
+    // the known part of the stream: history, then the frame
+    auto   stream = mStream.segment(mHistorySize - history, history + size);
+    double peak = in.abs().maxCoeff();
+    for (index p = 1; p < mFactor; p++)
+    {
+      index first = mPhaseStart[asUnsigned(p)];
+      index last = first + mPhaseTaps - 1;
+      // output n reads stream samples n - last to n - first
+      index begin = std::max(last, history + first);
+      index count = history + size + first - begin;
+      if (count <= 0) continue;
+      auto out = mInterpolated.head(count);
+      out.setZero();
+      for (index k = 0; k < mPhaseTaps; k++)
+      {
+        double c = mPhases(p, k);
+        if (c != 0) out += c * stream.segment(begin - (first + k), count);
+      }
+      peak = std::max(peak, out.abs().maxCoeff());
+    }
+    // the samples before the next frame, unless there is a gap
+    if (mHopSize > size)
+      mHistory = 0;
     else
     {
-      double   peak;
-      ArrayXcd transform = mFFT.process(in);
-      mBuffer.setZero();
-      mBuffer.segment(0, transform.size()) = transform;
-      ArrayXd result = mIFFT.process(mBuffer);
-      ArrayXd scaled = result / mFFTSize;
-      peak = scaled.abs().maxCoeff();
-      return peak;
+      mHistory = std::min(mHistorySize, history + mHopSize);
+      std::copy(mStream.data() + mHistorySize + mHopSize - mHistory,
+                mStream.data() + mHistorySize + mHopSize,
+                mStream.data() + mHistorySize - mHistory);
     }
+    return peak;
   }
 
-private:
-  FFT      mFFT;
-  IFFT     mIFFT;
-  ArrayXcd mBuffer;
-  double   mSampleRate{44100.0};
-  index    mFactor{4};
-  index    mFFTSize{1024};
+  double processFFT(const RealVectorView& input)
+  {
+    using namespace Eigen;
+    ArrayXd  in = _impl::asEigen<Array>(input);
+    ArrayXcd transform = mFFT.process(in);
+    mBuffer.setZero();
+    mBuffer.segment(0, transform.size()) = transform;
+    ArrayXd result = mIFFT.process(mBuffer);
+    ArrayXd scaled = result / mFFTSize;
+    return scaled.abs().maxCoeff();
+  }
+
+  FFT                mFFT;
+  IFFT               mIFFT;
+  ArrayXcd           mBuffer;
+  ArrayXXd           mPhases;
+  std::vector<index> mPhaseStart;
+  index              mPhaseTaps{0};
+  ArrayXd            mInterpolated;
+  ArrayXd            mStream;
+  index              mHopSize{1024};
+  index              mHistorySize{0};
+  index              mHistory{0};
+  double             mSampleRate{44100.0};
+  index              mFactor{4};
+  index              mFFTSize{1024};
 };
 } // namespace algorithm
 } // namespace fluid
@@ -0,0 +1,125 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "../../data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+#include <Eigen/QR>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace fluid {
+namespace algorithm {
+
+// The k eigenpairs of largest magnitude of a symmetric matrix, by randomized
+// subspace iteration (Halko, Martinsson and Tropp, 2011): the range of A is
+// sampled with k + oversampling random vectors, sharpened by a few power
+// iterations, and A is then solved exactly on that small subspace. Iteration
+// carries on until every wanted pair's residual |A v - lambda v| is within
+// tolerance of the largest eigenvalue, or for at most n / (4 l) passes of
+// 2 n^2 l flops each (l = k + oversampling), which keeps the worst case, where
+// the spectrum has no gap, well below the cost of a dense solve. Matrices that
+// are small compared to the subspace are solved directly
+class TruncatedEigen
+{
+  using MatrixXd = Eigen::MatrixXd;
+  using VectorXd = Eigen::VectorXd;
+
+public:
+  void compute(const Eigen::Ref<const MatrixXd>& A, index k,
+               index oversampling = 10, index iterations = 4,
+               double tolerance = 1e-6)
+  {
+    using namespace Eigen;
+    assert(A.rows() == A.cols());
+    assert(k > 0 && k <= A.rows());
+    index n = A.rows();
+    index l = std::min(k + oversampling, n);
+    if (4 * l >= n)
+    {
+      SelfAdjointEigenSolver<MatrixXd> solver(A);
+      select(solver.eigenvalues(), solver.eigenvectors(), k);
+      return;
+    }
+    index maxPasses = std::max(iterations + 1, n / (4 * l));
+    std::mt19937                     gen(42); // reproducible results
+    std::normal_distribution<double> normal;
+    mQ.resize(n, l);
+    for (index i = 0; i < mQ.size(); i++) mQ(i) = normal(gen);
+    orthonormalize(mQ);
+    for (index pass = 0;; pass++)
+    {
+      mY.noalias() = A * mQ;
+      if (pass >= iterations)
+      {
+        // Rayleigh-Ritz on the current subspace, and the residuals
+        // A V - V Lambda = Y W - Q W Lambda of its k leading pairs
+        mT.noalias() = mQ.transpose() * mY;
+        SelfAdjointEigenSolver<MatrixXd> solver(mT);
+        select(solver.eigenvalues(), solver.eigenvectors(), k);
+        mW = mVectors;
+        mVectors.noalias() = mQ * mW;
+        mResiduals.noalias() = mY * mW;
+        mResiduals -= mVectors * mValues.asDiagonal();
+        double scale = std::abs(mValues(0));
+        if (pass + 1 >= maxPasses ||
+            mResiduals.colwise().norm().maxCoeff() <= tolerance * scale)
+          return;
+      }
+      mQ = mY;
+      orthonormalize(mQ);
+    }
+  }
+
+  /// Eigenvalues, in decreasing order of magnitude
+  const VectorXd& eigenvalues() const { return mValues; }
+
+  /// Eigenvectors, as columns in the order of eigenvalues()
+  const MatrixXd& eigenvectors() const { return mVectors; }
+
+private:
+  static void orthonormalize(MatrixXd& M)
+  {
+    Eigen::HouseholderQR<MatrixXd> qr(M);
+    M = qr.householderQ() * MatrixXd::Identity(M.rows(), M.cols());
+  }
+
+  void select(const VectorXd& values, const MatrixXd& vectors, index k)
+  {
+    std::vector<index> order(asUnsigned(values.size()));
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](index a, index b) {
+      return std::abs(values(a)) > std::abs(values(b));
+    });
+    mValues.resize(k);
+    mVectors.resize(vectors.rows(), k);
+    for (index i = 0; i < k; i++)
+    {
+      mValues(i) = values(order[asUnsigned(i)]);
+      mVectors.col(i) = vectors.col(order[asUnsigned(i)]);
+    }
+  }
+
+  MatrixXd mQ;
+  MatrixXd mY;
+  MatrixXd mT;
+  MatrixXd mW;
+  MatrixXd mResiduals;
+  VectorXd mValues;
+  MatrixXd mVectors;
+};
+} // namespace algorithm
+} // namespace fluid
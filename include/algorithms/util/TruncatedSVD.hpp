@@ -0,0 +1,130 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include "../../data/FluidIndex.hpp"
+#include <Eigen/Core>
+#include <Eigen/QR>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+namespace fluid {
+namespace algorithm {
+
+// The k largest singular values and right singular vectors of A - 1 * offset^T
+// (each row of A minus offset), by randomized subspace iteration (Halko,
+// Martinsson and Tropp, 2011): the range of the matrix is sampled with
+// l = k + oversampling random vectors, sharpened by a fixed number of power
+// iterations, and the matrix is then decomposed exactly on that small
+// subspace (Rayleigh-Ritz). Further passes are only made while the k leading
+// singular values still move by more than tolerance relative to the largest,
+// and only up to max(iterations + 1, d / (2 l)) passes in all. The power
+// iterations are always made, so only when d >= 2 l (iterations + 1) does the
+// worst case cost about half a dense decomposition; narrower data costs a few
+// passes more. The offset is applied inside the products, so A is never
+// copied. When the subspace would cover most of the columns anyway it takes
+// all of them, and the first pass is exact
+class TruncatedSVD
+{
+  using MatrixXd = Eigen::MatrixXd;
+  using VectorXd = Eigen::VectorXd;
+  using RowVectorXd = Eigen::RowVectorXd;
+
+public:
+  template <typename Derived>
+  void compute(const Eigen::MatrixBase<Derived>&  A,
+               const Eigen::Ref<const VectorXd>& offset, index k,
+               index oversampling = 10, index iterations = 4,
+               double tolerance = 1e-6)
+  {
+    using namespace Eigen;
+    index n = A.rows();
+    index d = A.cols();
+    assert(offset.size() == d);
+    assert(k > 0 && k <= std::min(n, d));
+    index l = std::min(k + oversampling, std::min(n, d));
+    bool  exact = 4 * l >= d;
+    if (exact) l = std::min(n, d);
+    index maxPasses = exact ? 1 : std::max(iterations + 1, d / (2 * l));
+    std::mt19937                     gen(42); // reproducible results
+    std::normal_distribution<double> normal;
+    mOmega.resize(d, l);
+    for (index i = 0; i < mOmega.size(); i++) mOmega(i) = normal(gen);
+    for (index pass = 0;; pass++)
+    {
+      // Q = orth(X * Omega), then Omega = X^T * Q
+      multiply(A, offset, mOmega, mQ);
+      orthonormalize(mQ);
+      multiplyTransposed(A, offset, mQ, mOmega);
+      if (pass >= iterations || pass + 1 >= maxPasses)
+      {
+        // the SVD of X^T * Q gives that of X on the subspace
+        JacobiSVD<MatrixXd> svd(mOmega, ComputeThinU);
+        bool converged =
+            pass > iterations &&
+            (svd.singularValues().head(k) - mValues).cwiseAbs().maxCoeff() <=
+                tolerance * svd.singularValues()(0);
+        mValues = svd.singularValues().head(k);
+        if (converged || pass + 1 >= maxPasses)
+        {
+          mVectors = svd.matrixU().leftCols(k);
+          return;
+        }
+      }
+      orthonormalize(mOmega);
+    }
+  }
+
+  /// Singular values, in decreasing order
+  const VectorXd& singularValues() const { return mValues; }
+
+  /// Right singular vectors, as columns in the order of singularValues()
+  const MatrixXd& matrixV() const { return mVectors; }
+
+private:
+  // X * M = A * M - 1 * (offset^T * M)
+  template <typename Derived>
+  void multiply(const Eigen::MatrixBase<Derived>&  A,
+                const Eigen::Ref<const VectorXd>& offset, const MatrixXd& M,
+                MatrixXd& out)
+  {
+    mColumnSums.noalias() = offset.transpose() * M;
+    out.noalias() = A * M;
+    out.rowwise() -= mColumnSums;
+  }
+
+  // X^T * M = A^T * M - offset * (column sums of M)
+  template <typename Derived>
+  void multiplyTransposed(const Eigen::MatrixBase<Derived>&  A,
+                          const Eigen::Ref<const VectorXd>& offset,
+                          const MatrixXd& M, MatrixXd& out)
+  {
+    mColumnSums = M.colwise().sum();
+    out.noalias() = A.transpose() * M;
+    out.noalias() -= offset * mColumnSums;
+  }
+
+  static void orthonormalize(MatrixXd& M)
+  {
+    Eigen::HouseholderQR<MatrixXd> qr(M);
+    M = qr.householderQ() * MatrixXd::Identity(M.rows(), M.cols());
+  }
+
+  MatrixXd    mOmega;
+  MatrixXd    mQ;
+  RowVectorXd mColumnSums;
+  VectorXd    mValues;
+  MatrixXd    mVectors;
+};
+} // namespace algorithm
+} // namespace fluid
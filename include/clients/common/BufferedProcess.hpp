@@ -42,13 +42,25 @@ public:
            "Window in bigger than maximum");
     assert(windowSizeOut <= maxWindowSizeOut() &&
            "Window out bigger than maximum");
+    // Frames that tile the output exactly can be written straight into the
+    // sink, rather than via mFrameOut and an overlap-add
+    bool tiled = windowSizeOut == hopSize;
+    if (!tiled) mTiledOutput = false;
     for (; mFrameTime < mHostSize; mFrameTime += hopSize)
     {
-      RealMatrixView windowIn = mFrameIn(Slice(0), Slice(0, windowSizeIn));
-      RealMatrixView windowOut = mFrameOut(Slice(0), Slice(0, windowSizeOut));
-      mSource.pull(windowIn, mFrameTime);
-      processFunc(windowIn, windowOut);
-      mSink.push(windowOut, mFrameTime);
+      RealMatrixView windowIn = inputFrame(windowSizeIn);
+      RealMatrixView direct =
+          tiled && mTiledOutput ? mSink.view(mFrameTime, windowSizeOut)
+                                : RealMatrixView(nullptr, 0, 0, 0);
+      if (direct.data())
+        processFunc(windowIn, direct);
+      else
+      {
+        RealMatrixView windowOut =
+            mFrameOut(Slice(0), Slice(0, windowSizeOut));
+        processFunc(windowIn, windowOut);
+        mSink.push(windowOut, mFrameTime);
+      }
 
       if (FluidTask* t = c.task())
         if (!t->processUpdate(
@@ -66,9 +78,7 @@ public:
     assert(windowSize <= maxWindowSizeIn() && "Window bigger than maximum");
     for (; mFrameTime < mHostSize; mFrameTime += hopSize)
     {
-      RealMatrixView windowIn = mFrameIn(Slice(0), Slice(0, windowSize));
-      mSource.pull(windowIn, mFrameTime);
-      processFunc(windowIn);
+      processFunc(inputFrame(windowSize));
 
       if (FluidTask* t = c.task())
         if (!t->processUpdate(
@@ -108,6 +118,7 @@ public:
     mSink.setHostBufferSize(size);
     mSource.reset();
     mSink.reset();
+    mTiledOutput = true;
   }
 
   index maxWindowSizeIn() const noexcept { return mFrameIn.cols(); }
@@ -127,6 +138,7 @@ public:
       mFrameOut.resize(channelsOut, framesOut);
 
     mFrameTime = 0;
+    mTiledOutput = true;
   }
 
   template <typename T>
@@ -155,11 +167,29 @@ public:
     mSource.reset();
     mSink.reset();
     mFrameTime = 0;
+    mTiledOutput = true;
   }
 
 private:
+  // Input windows are handed out as views straight into the source buffer,
+  // so processing functions must treat them as read-only.
+  // A frame at mFrameTime ends that far into the current host vector, so a
+  // frame at time 0 reads all of the previous one. Only frames that fit in
+  // the current vector could be read from host memory, and the ring still has
+  // to hold a maximum window either side of each vector boundary, so input is
+  // always staged in mSource
+  RealMatrixView inputFrame(index windowSize)
+  {
+    RealMatrixView window = mSource.view(mFrameTime, windowSize);
+    if (window.data()) return window;
+    RealMatrixView silence = mFrameIn(Slice(0), Slice(0, windowSize));
+    silence.fill(0);
+    return silence;
+  }
+
   index               mFrameTime = 0;
   index               mHostSize;
+  bool                mTiledOutput{true};
   RealMatrix          mFrameIn;
   RealMatrix          mFrameOut;
   FluidSource<double> mSource;
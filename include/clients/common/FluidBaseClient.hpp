@@ -185,6 +185,10 @@ public:
 
   const Client& client() const { return mClient; }
 
+  // A new client on the same parameters, in its initial state: the client's
+  // own state is not copied
+  ClientWrapper freshFromParams() const { return ClientWrapper{mParams.get()}; }
+
   void reset() { mClient.reset(); }
 
   template <typename T, typename Context>
@@ -19,6 +19,7 @@ under the European Union’s Horizon 2020 research and innovation programme
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
 #include "../../data/TensorTypes.hpp"
+#include <chrono>
 #include <deque>
 #include <future>
 #include <thread>
@@ -150,6 +151,10 @@ template <typename C>
 using NonFFT = std::enable_if_t<AddPadding<C>::value == 0>;
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clients that can be processed offline in segments, see processChannel()
+template <typename T>
+using SegmentWarmupTest = decltype(std::declval<const T&>().segmentWarmup());
+
 template <typename HostMatrix, typename HostVectorView>
 struct StreamingControl;
 
@@ -345,7 +350,7 @@ public:
 
     Result processResult = AdaptorType<HostMatrix, HostVectorView>::process(
         mClient, inputBuffers, outputBuffers, numFrames, numChannels,
-        userPadding<>(), c);
+        userPadding<>(), numSegments<>(), c);
 
     if (!processResult.ok())
     {
@@ -411,6 +416,24 @@ public:
   }
 
 
+  // see processChannel(): clients that can be split into segments take their
+  // number from the parameter that follows the output buffers
+  template <typename C = RTClient>
+  std::enable_if_t<isDetected<SegmentWarmupTest, typename C::Client>::value,
+                   index>
+  numSegments()
+  {
+    return std::max<index>(get<Ins * 5 + decideOuts>(), 1);
+  }
+
+  template <typename C = RTClient>
+  std::enable_if_t<!isDetected<SegmentWarmupTest, typename C::Client>::value,
+                   index>
+  numSegments()
+  {
+    return 1;
+  }
+
 private:
   template <size_t N, typename T>
   struct GetWinSize
@@ -453,6 +476,181 @@ private:
   RTParamSetViewType                       mRealTimeParams;
   WrappedClient                            mClient;
 };
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// Streaming clients whose output mostly depends on a bounded stretch of past
+// input declare it with segmentWarmup() and segmentAlignment(), and with
+// segmentHistory() how many samples of their own past output, together with
+// the input, settle their state at an alignment boundary. Offline, such a
+// client can then be asked, by the NRT parameter that follows the output
+// buffers, to process a long buffer as that many segments on separate threads:
+// each segment starts on an alignment boundary and is run by a fresh instance
+// of the client from segmentWarmup() samples earlier. Segments are then joined
+// in order: one whose warm-up output over the last segmentHistory() samples is
+// identical to what came before it is in the same state as a single pass would
+// be, and only its own part is kept. Otherwise state carried from further back
+// has not settled, and the rest of the buffer is processed again in one pass
+// that replays the previous segment's run. Either way the output is exactly
+// that of a single pass, only slower where it has to fall back. The split
+// depends on the parameter and the input length only, never on the machine
+template <typename Client, typename HostVectorView>
+std::enable_if_t<!isDetected<SegmentWarmupTest, typename Client::Client>::value>
+processChannel(Client& client, std::vector<HostVectorView>& inputs,
+               std::vector<HostVectorView>& outputs, index /*nSegments*/,
+               FluidContext& c)
+{
+  client.reset();
+  client.process(inputs, outputs, c);
+}
+
+template <typename Client, typename HostVectorView>
+std::enable_if_t<isDetected<SegmentWarmupTest, typename Client::Client>::value>
+processChannel(Client& client, std::vector<HostVectorView>& inputs,
+               std::vector<HostVectorView>& outputs, index nSegments,
+               FluidContext& c)
+{
+  // segments are run in double precision, so that joins compare exactly what
+  // the client keeps in its state
+  using SegmentMatrix = FluidTensor<double, 2>;
+  using SegmentView = FluidTensorView<double, 1>;
+
+  index nFrames = inputs[0].size();
+  index nOutputs = asSigned(outputs.size());
+  index alignment = std::max<index>(client.client().segmentAlignment(), 1);
+  index warmup = ((client.client().segmentWarmup() + alignment - 1) /
+                  alignment) * alignment;
+  index history = client.client().segmentHistory();
+  assert(history <= warmup);
+  // keep segments long enough for the warm-up to be a small overhead
+  nSegments = std::min(nSegments, nFrames / (4 * std::max(warmup, alignment)));
+
+  client.reset();
+
+  if (nSegments < 2)
+  {
+    client.process(inputs, outputs, c);
+    return;
+  }
+
+  index segmentSize =
+      ((nFrames + nSegments - 1) / nSegments + alignment - 1) / alignment *
+      alignment;
+  nSegments = (nFrames + segmentSize - 1) / segmentSize;
+
+  auto segmentStart = [segmentSize](index segment) {
+    return segment * segmentSize;
+  };
+  auto segmentFrom = [segmentSize, warmup](index segment) {
+    return std::max<index>(segment * segmentSize - warmup, 0);
+  };
+
+  // runs a client over [from, end) in double precision into result
+  auto run = [&inputs, nOutputs](Client& runClient, index from, index end,
+                                 SegmentMatrix& result, FluidTask& task) {
+    index         size = end - from;
+    SegmentMatrix input(asSigned(inputs.size()), size);
+    std::vector<SegmentView> runInputs, runOutputs;
+    for (index i = 0; i < asSigned(inputs.size()); ++i)
+    {
+      input.row(i) = inputs[asUnsigned(i)](Slice(from, size));
+      runInputs.push_back(input.row(i));
+    }
+    result = SegmentMatrix(nOutputs, size);
+    for (index i = 0; i < nOutputs; ++i) runOutputs.push_back(result.row(i));
+    FluidContext runContext{task};
+    runClient.process(runInputs, runOutputs, runContext);
+  };
+
+  // each run reports to a task of its own: these are gathered into the
+  // caller's task, as a number of segments done, and cancelled with it
+  FluidTask* task = c.task();
+  auto       wait = [task, nSegments](std::vector<std::future<void>>& runs,
+                                FluidTask* runTasks, index nTasks,
+                                double done, double weight) {
+    auto reportProgress = [&]() {
+      if (!task) return;
+      double progress = done;
+      for (index i = 0; i < nTasks; ++i)
+        progress += weight * runTasks[i].progress();
+      if (!task->processUpdate(progress, static_cast<double>(nSegments)))
+        for (index i = 0; i < nTasks; ++i) runTasks[i].cancel();
+    };
+    for (auto& r : runs)
+      while (r.wait_for(std::chrono::milliseconds(20)) !=
+             std::future_status::ready)
+        reportProgress();
+    reportProgress();
+    return !task || !task->cancelled();
+  };
+
+  std::vector<Client> clients;
+  clients.reserve(asUnsigned(nSegments - 1));
+  for (index i = 1; i < nSegments; ++i)
+  {
+    clients.emplace_back(client.freshFromParams());
+    clients.back().sampleRate(client.sampleRate());
+  }
+
+  std::vector<FluidTask>         tasks(asUnsigned(nSegments));
+  std::vector<SegmentMatrix>     results(asUnsigned(nSegments));
+  std::vector<std::future<void>> runs;
+  runs.reserve(asUnsigned(nSegments));
+  for (index i = 0; i < nSegments; ++i)
+  {
+    runs.push_back(std::async(
+        std::launch::async, run,
+        std::ref(i == 0 ? client : clients[asUnsigned(i - 1)]), segmentFrom(i),
+        std::min(segmentStart(i + 1), nFrames),
+        std::ref(results[asUnsigned(i)]), std::ref(tasks[asUnsigned(i)])));
+  }
+  if (!wait(runs, tasks.data(), nSegments, 0, 1)) return;
+
+  for (index i = 0; i < nSegments; ++i)
+  {
+    index start = segmentStart(i);
+    bool  settled = true;
+    for (index j = 0; i > 0 && j < nOutputs && settled; ++j)
+    {
+      auto previous = results[asUnsigned(i - 1)].row(j);
+      auto current = results[asUnsigned(i)].row(j);
+      for (index k = start - history; k < start && settled; ++k)
+      {
+        settled = previous(k - segmentFrom(i - 1)) ==
+                  current(k - segmentFrom(i));
+      }
+    }
+    if (!settled)
+    {
+      // replaying the previous segment's run, whose state was settled, and
+      // going on to the end
+      Client rest = client.freshFromParams();
+      rest.sampleRate(client.sampleRate());
+      FluidTask                      restTask;
+      std::vector<std::future<void>> restRun;
+      restRun.push_back(std::async(std::launch::async, run, std::ref(rest),
+                                   segmentFrom(i - 1), nFrames,
+                                   std::ref(results[asUnsigned(i)]),
+                                   std::ref(restTask)));
+      if (!wait(restRun, &restTask, 1, static_cast<double>(i - 1),
+                static_cast<double>(nSegments - i + 1)))
+        return;
+      for (index j = 0; j < nOutputs; ++j)
+      {
+        outputs[asUnsigned(j)](Slice(start, nFrames - start)) =
+            results[asUnsigned(i)].row(j)(
+                Slice(start - segmentFrom(i - 1), nFrames - start));
+      }
+      return;
+    }
+    index end = std::min(segmentStart(i + 1), nFrames);
+    for (index j = 0; j < nOutputs; ++j)
+    {
+      outputs[asUnsigned(j)](Slice(start, end - start)) =
+          results[asUnsigned(i)].row(j)(
+              Slice(start - segmentFrom(i), end - start));
+    }
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 template <typename HostMatrix, typename HostVectorView>
 struct Streaming
@@ -460,7 +658,8 @@ struct Streaming
   template <typename Client, typename InputList, typename OutputList>
   static Result process(Client& client, InputList& inputBuffers,
                         OutputList& outputBuffers, index nFrames, index nChans,
-                        std::pair<index, index> userPadding, FluidContext& c)
+                        std::pair<index, index> userPadding,
+                        index nSegments, FluidContext& c)
   {
     // To account for process latency we need to copy the buffers with padding
     std::vector<HostMatrix> outputData;
@@ -502,8 +701,7 @@ struct Streaming
         c.task()->iterationUpdate(static_cast<double>(i),
                                   static_cast<double>(nChans));
 
-      client.reset();
-      client.process(inputs, outputs, c);
+      processChannel(client, inputs, outputs, nSegments, c);
     }
 
     for (index i = 0; i < asSigned(outputBuffers.size()); ++i)
@@ -527,7 +725,8 @@ struct StreamingControl
   template <typename Client, typename InputList, typename OutputList>
   static Result process(Client& client, InputList& inputBuffers,
                         OutputList& outputBuffers, index nFrames, index nChans,
-                        std::pair<index, index> userPadding, FluidContext& c)
+                        std::pair<index, index> userPadding,
+                        index /*nSegments*/, FluidContext& c)
   {
     // To account for process latency we need to copy the buffers with padding
     std::vector<HostMatrix> inputData;
@@ -636,7 +835,8 @@ struct Slicing
   template <typename Client, typename InputList, typename OutputList>
   static Result process(Client& client, InputList& inputBuffers,
                         OutputList& outputBuffers, index nFrames, index nChans,
-                        std::pair<index, index> /*userPadding*/, FluidContext& c)
+                        std::pair<index, index> /*userPadding*/,
+                        index nSegments, FluidContext& c)
   {
 
     assert(inputBuffers.size() == 1);
@@ -660,8 +860,7 @@ struct Slicing
     std::vector<HostVectorView> input{monoSource.row(0)};
     std::vector<HostVectorView> output{onsetPoints.row(0)};
 
-    client.reset();
-    client.process(input, output, c);
+    processChannel(client, input, output, nSegments, c);
 
     if (startPadding)
     {
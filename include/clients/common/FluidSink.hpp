@@ -66,6 +66,27 @@ public:
     addIn(x(Slice(0), Slice(size, blocksize - size)), 0, blocksize - size);
   }
 
+  /// View of the region a frame would be accumulated into, so that it can be
+  /// written in place when frames don't overlap. Returns a view with null data
+  /// if the frame would wrap around the end of the buffer
+  View view(index frameTime, index blocksize)
+  {
+    assert(blocksize <= bufferSize());
+
+    index offset = frameTime;
+
+    if (offset + blocksize > bufferSize())
+      return View(nullptr, 0, mChannels, blocksize);
+
+    offset += mCounter;
+    offset = offset < bufferSize() ? offset : offset - bufferSize();
+
+    if (offset + blocksize > bufferSize())
+      return View(nullptr, 0, mChannels, blocksize);
+
+    return matrix(Slice(0), Slice(offset, blocksize));
+  }
+
   /// Copy data from the buffer, and zero where it was
   template <typename U>
   void pull(FluidTensorView<U, 2> out)
@@ -12,11 +12,14 @@ under the European Union’s Horizon 2020 research and innovation programme
 
 #include "../../data/FluidIndex.hpp"
 #include "../../data/FluidTensor.hpp"
+#include <algorithm>
 #include <cassert>
 
 namespace fluid {
 
-/// Input buffer, with possibly overlapped reads
+/// Input buffer, with possibly overlapped reads.
+/// The first size() frames of the ring are mirrored past its end, so that any
+/// window of up to size() frames can be read contiguously, without wrapping
 template <typename T>
 class FluidSource
 {
@@ -62,25 +65,27 @@ public:
   /// Pull a frame of data out of the buffer.
   void pull(View out, index frameTime)
   {
-    index blocksize = out.cols();
+    View frame = view(frameTime, out.cols());
+    if (frame.data())
+      out = frame;
+    else
+      out.fill(0);
+  }
+
+  /// Contiguous, read-only view of a frame in the buffer, without copying.
+  /// Returns a view with null data if the frame is no longer available
+  View view(index frameTime, index blocksize)
+  {
+    assert(blocksize <= mSize);
     index offset = mHostBufferSize - frameTime;
 
-    if (offset > bufferSize())
-    {
-      out.fill(0);
-      return;
-    }
+    if (offset > bufferSize()) return View(nullptr, 0, mChannels, blocksize);
 
     offset += blocksize;
     offset = (offset <= mCounter) ? mCounter - offset
                                   : mCounter + bufferSize() - offset;
 
-    index size =
-        (offset + blocksize > bufferSize()) ? bufferSize() - offset : blocksize;
-
-    out(Slice(0), Slice(0, size)) = matrix(Slice(0), Slice(offset, size));
-    out(Slice(0), Slice(size, blocksize - size)) =
-        matrix(Slice(0), Slice(0, blocksize - size));
+    return matrix(Slice(0), Slice(offset, blocksize));
   }
 
   void setHostBufferSize(const index size) { mHostBufferSize = size; }
@@ -92,8 +97,8 @@ public:
 
     if (channels) mChannels = channels;
 
-    if (matrix.cols() != bufferSize() || matrix.rows() != channels)
-    { matrix.resize(mChannels, bufferSize()); }
+    if (matrix.cols() != storageSize() || matrix.rows() != channels)
+    { matrix.resize(mChannels, storageSize()); }
     matrix.fill(0);
     mCounter = 0;
   }
@@ -106,6 +111,7 @@ public:
 
 private:
   index bufferSize() const { return mSize + mHostBufferSize; }
+  index storageSize() const { return bufferSize() + mSize; }
 
 
   template <typename U>
@@ -147,6 +153,13 @@ private:
     if (size)
     {
       matrix(chans, Slice(offset, size)) = input;
+      // mirror the head of the ring into the guard region past its end
+      if (offset < mSize)
+      {
+        index mirrorSize = std::min(size, mSize - offset);
+        matrix(chans, Slice(offset + bufferSize(), mirrorSize)) =
+            input(Slice(0), Slice(0, mirrorSize));
+      }
       if (incrementTime) mCounter = offset + size;
     }
   }
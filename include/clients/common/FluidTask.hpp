@@ -40,7 +40,7 @@ public:
 
 private:
   std::atomic<double> mProgress;
-  bool                mCancel;
+  std::atomic<bool>   mCancel;
   double              mTotalIterations{1};
   // if a wrapped single channel RT process is being run over multiple
   // channels, progress needs reflect the total proportion, rather than
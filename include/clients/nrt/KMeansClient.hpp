@@ -23,7 +23,11 @@ namespace kmeans {
 constexpr auto KMeansParams = defineParameters(
     StringParam<Fixed<true>>("name", "Name"),
     LongParam("numClusters", "Number of Clusters", 4, Min(1)),
-    LongParam("maxIter", "Max number of Iterations", 100, Min(1)));
+    LongParam("maxIter", "Max number of Iterations", 100, Min(1)),
+    LongParam("batchSize", "Mini-batch Size (0 for full batch)", 0, Min(0)),
+    FloatParam("tolerance", "Convergence Tolerance", 0, Min(0)),
+    LongParam("numThreads", "Number of Threads (0 for all cores)", 0, Min(0)),
+    LongParam("seed", "Random Seed (-1 for random)", -1, Min(-1)));
 
 class KMeansClient : public FluidBaseClient,
                      OfflineIn,
@@ -31,7 +35,15 @@ class KMeansClient : public FluidBaseClient,
                      ModelObject,
                      public DataClient<algorithm::KMeans>
 {
-  enum { kName, kNumClusters, kMaxIter };
+  enum {
+    kName,
+    kNumClusters,
+    kMaxIter,
+    kBatchSize,
+    kTolerance,
+    kNumThreads,
+    kSeed
+  };
 
 public:
   using string = std::string;
@@ -77,7 +89,9 @@ public:
     auto dataSet = datasetClientPtr->getDataSet();
     if (dataSet.size() == 0) return Error<IndexVector>(EmptyDataSet);
     if (k <= 1) return Error<IndexVector>(SmallK);
-    mAlgorithm.train(dataSet, k, maxIter);
+    if (dataSet.size() < k) return Error<IndexVector>(SmallDataSet);
+    mAlgorithm.train(dataSet, k, maxIter, get<kBatchSize>(), get<kTolerance>(),
+                     get<kNumThreads>(), get<kSeed>());
     IndexVector assignments(dataSet.size());
     mAlgorithm.getAssignments(assignments);
     return getCounts(assignments, k);
@@ -95,8 +109,10 @@ public:
     auto labelsetClientPtr = labelsetClient.get().lock();
     if (!labelsetClientPtr) return Error<IndexVector>(NoLabelSet);
     if (k <= 1) return Error<IndexVector>(SmallK);
+    if (dataSet.size() < k) return Error<IndexVector>(SmallDataSet);
     if (maxIter <= 0) maxIter = 100;
-    mAlgorithm.train(dataSet, k, maxIter);
+    mAlgorithm.train(dataSet, k, maxIter, get<kBatchSize>(), get<kTolerance>(),
+                     get<kNumThreads>(), get<kSeed>());
     IndexVector assignments(dataSet.size());
     mAlgorithm.getAssignments(assignments);
     StringVectorView ids = dataSet.getIds();
@@ -118,12 +134,7 @@ public:
       return Error<IndexVector>(WrongPointSize);
     StringVectorView ids = dataSet.getIds();
     IndexVector      assignments(dataSet.size());
-    RealVector       query(mAlgorithm.dims());
-    for (index i = 0; i < dataSet.size(); i++)
-    {
-      dataSet.get(ids(i), query);
-      assignments(i) = mAlgorithm.vq(query);
-    }
+    mAlgorithm.vq(dataSet.getData(), assignments, get<kNumThreads>());
     labelsetClientPtr->setLabelSet(getLabels(ids, assignments));
     return getCounts(assignments, mAlgorithm.getK());
   }
@@ -145,7 +156,8 @@ public:
 
     StringVectorView ids = srcDataSet.getIds();
     RealMatrix       output(srcDataSet.size(), mAlgorithm.size());
-    mAlgorithm.getDistances(srcDataSet.getData(), output);
+    mAlgorithm.getDistances(srcDataSet.getData(), output,
+                            get<kNumThreads>());
     FluidDataSet<string, double, 1> result(ids, output);
     destPtr->setDataSet(result);
     return OK();
@@ -163,8 +175,10 @@ public:
     auto dataSet = srcPtr->getDataSet();
     if (dataSet.size() == 0) return Error<IndexVector>(EmptyDataSet);
     if (k <= 1) return Error<IndexVector>(SmallK);
+    if (dataSet.size() < k) return Error<IndexVector>(SmallDataSet);
     if (maxIter <= 0) maxIter = 100;
-    mAlgorithm.train(dataSet, k, maxIter);
+    mAlgorithm.train(dataSet, k, maxIter, get<kBatchSize>(), get<kTolerance>(),
+                     get<kNumThreads>(), get<kSeed>());
     IndexVector assignments(dataSet.size());
     mAlgorithm.getAssignments(assignments);
     transform(srcClient, dstClient);
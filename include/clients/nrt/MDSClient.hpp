@@ -18,13 +18,15 @@ namespace fluid {
 namespace client {
 namespace mds {
 
-enum { kNumDimensions, kDistance };
+enum { kNumDimensions, kDistance, kNumLandmarks };
 
 constexpr auto MDSParams = defineParameters(
     LongParam("numDimensions", "Target Number of Dimensions", 2, Min(1)),
     EnumParam("distanceMetric", "Distance Metric", 1, "Manhattan", "Euclidean",
               "Squared Euclidean", "Max Distance", "Min Distance",
-              "KL Divergence"));
+              "KL Divergence"),
+    LongParam("numLandmarks", "Number of Landmarks (0 for all points)", 0,
+              Min(0)));
 
 class MDSClient : public FluidBaseClient, OfflineIn, OfflineOut, ModelObject
 {
@@ -62,6 +64,7 @@ public:
   {
     index k = get<kNumDimensions>();
     index dist = get<kDistance>();
+    index landmarks = get<kNumLandmarks>();
     auto  srcPtr = sourceClient.get().lock();
     auto  destPtr = destClient.get().lock();
     if (!srcPtr || !destPtr) return Error(NoDataSet);
@@ -69,11 +72,14 @@ public:
     auto dest = destPtr->getDataSet();
     if (src.size() == 0) return Error(EmptyDataSet);
     if (k <= 0) return Error(SmallK);
+    if (k > src.size()) return Error(LargeK);
     if (dist < 0 || dist > 6) return Error("dist should be  between 0 and 6");
+    if (landmarks > 0 && landmarks < src.size() && landmarks < k)
+      return Error("numLandmarks should be at least numDimensions");
 
     StringVector ids{src.getIds()};
     RealMatrix   output(src.size(), k);
-    mAlgorithm.process(src.getData(), output, dist, k);
+    mAlgorithm.process(src.getData(), output, dist, k, landmarks);
     FluidDataSet<string, double, 1> result(ids, output);
     destPtr->setDataSet(result);
     return OK();
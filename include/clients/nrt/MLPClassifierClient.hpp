@@ -65,7 +65,11 @@ constexpr auto MLPClassifierParams = defineParameters(
     FloatParam("learnRate", "Learning Rate", 0.01, Min(0.0), Max(1.0)),
     FloatParam("momentum", "Momentum", 0.5, Min(0.0), Max(0.99)),
     LongParam("batchSize", "Batch Size", 50),
-    FloatParam("validation", "Validation Amount", 0.2, Min(0), Max(0.9)));
+    FloatParam("validation", "Validation Amount", 0.2, Min(0), Max(0.9)),
+    LongParam("seed", "Random Seed (-1 for random)", -1, Min(-1)),
+    EnumParam("optimizer", "Optimizer", 0, "SGD", "RMSProp", "Adam"),
+    LongParam("patience", "Validation Patience", 10, Min(1)),
+    LongParam("numThreads", "Number of Threads (0 for all cores)", 0, Min(0)));
 
 
 class MLPClassifierClient : public FluidBaseClient,
@@ -82,7 +86,11 @@ class MLPClassifierClient : public FluidBaseClient,
     kRate,
     kMomentum,
     kBatchSize,
-    kVal
+    kVal,
+    kSeed,
+    kOptimizer,
+    kPatience,
+    kNumThreads
   };
 
 public:
@@ -159,7 +167,8 @@ public:
     {
       mAlgorithm.mlp.init(sourceDataSet.pointSize(),
                           mAlgorithm.encoder.numLabels(), get<kHidden>(),
-                          get<kActivation>(), 1); // sigmoid output
+                          get<kActivation>(), 1, // sigmoid output
+                          get<kSeed>());
     }
     mAlgorithm.mlp.setTrained(false);
     DataSet result(1);
@@ -173,10 +182,11 @@ public:
       mAlgorithm.encoder.encodeOneHot(tgt.row(i)(0), oneHot.row(i));
     }
 
-    algorithm::SGD sgd;
+    algorithm::SGD sgd(get<kPatience>());
     double         error =
         sgd.train(mAlgorithm.mlp, data, oneHot, get<kIter>(), get<kBatchSize>(),
-                  get<kRate>(), get<kMomentum>(), get<kVal>());
+                  get<kRate>(), get<kMomentum>(), get<kVal>(), get<kSeed>(),
+                  get<kOptimizer>(), get<kNumThreads>());
 
     return error;
   }
@@ -196,7 +206,7 @@ public:
     StringVector ids{srcDataSet.getIds()};
     RealMatrix   output(srcDataSet.size(), mAlgorithm.encoder.numLabels());
     mAlgorithm.mlp.process(srcDataSet.getData(), output, 0,
-                           mAlgorithm.mlp.size());
+                           mAlgorithm.mlp.size(), get<kNumThreads>());
     LabelSet result(1);
     for (index i = 0; i < srcDataSet.size(); i++)
     {
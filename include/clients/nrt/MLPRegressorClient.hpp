@@ -35,7 +35,11 @@ constexpr auto MLPRegressorParams = defineParameters(
     FloatParam("learnRate", "Learning Rate", 0.01, Min(0.0), Max(1.0)),
     FloatParam("momentum", "Momentum", 0.9, Min(0.0), Max(0.99)),
     LongParam("batchSize", "Batch Size", 50, Min(1)),
-    FloatParam("validation", "Validation Amount", 0.2, Min(0), Max(0.9)));
+    FloatParam("validation", "Validation Amount", 0.2, Min(0), Max(0.9)),
+    LongParam("seed", "Random Seed (-1 for random)", -1, Min(-1)),
+    EnumParam("optimizer", "Optimizer", 0, "SGD", "RMSProp", "Adam"),
+    LongParam("patience", "Validation Patience", 10, Min(1)),
+    LongParam("numThreads", "Number of Threads (0 for all cores)", 0, Min(0)));
 
 class MLPRegressorClient : public FluidBaseClient,
                            OfflineIn,
@@ -55,7 +59,11 @@ class MLPRegressorClient : public FluidBaseClient,
     kRate,
     kMomentum,
     kBatchSize,
-    kVal
+    kVal,
+    kSeed,
+    kOptimizer,
+    kPatience,
+    kNumThreads
   };
 
 public:
@@ -116,17 +124,19 @@ public:
     {
 
       mAlgorithm.init(sourceDataSet.pointSize(), targetDataSet.pointSize(),
-                      get<kHidden>(), get<kActivation>(), outputAct);
+                      get<kHidden>(), get<kActivation>(), outputAct,
+                      get<kSeed>());
     }
 
     mAlgorithm.setTrained(false);
     DataSet        result(1);
     auto           data = sourceDataSet.getData();
     auto           tgt = targetDataSet.getData();
-    algorithm::SGD sgd;
+    algorithm::SGD sgd(get<kPatience>());
     double         error =
         sgd.train(mAlgorithm, data, tgt, get<kIter>(), get<kBatchSize>(),
-                  get<kRate>(), get<kMomentum>(), get<kVal>());
+                  get<kRate>(), get<kMomentum>(), get<kVal>(), get<kSeed>(),
+                  get<kOptimizer>(), get<kNumThreads>());
     return error;
   }
 
@@ -154,7 +164,8 @@ public:
 
     StringVector ids{srcDataSet.getIds()};
     RealMatrix   output(srcDataSet.size(), outputSize);
-    mAlgorithm.process(srcDataSet.getData(), output, inputTap, outputTap);
+    mAlgorithm.process(srcDataSet.getData(), output, inputTap, outputTap,
+                       get<kNumThreads>());
     FluidDataSet<string, double, 1> result(ids, output);
     destPtr->setDataSet(result);
     return OK();
@@ -252,11 +263,21 @@ constexpr auto MLPRegressorQueryParams =
                      LongParam("tapIn", "Input Tap Index", 0, Min(0)),
                      LongParam("tapOut", "Output Tap Index", -1, Min(-1)),
                      BufferParam("inputPointBuffer", "Input Point Buffer"),
-                     BufferParam("predictionBuffer", "Prediction Buffer"));
+                     BufferParam("predictionBuffer", "Prediction Buffer"),
+                     EnumParam("precision", "Weight Precision", 0, "Double",
+                               "Single"));
 
 class MLPRegressorQuery : public FluidBaseClient, ControlIn, ControlOut
 {
-  enum { kModel, kInputTap, kOutputTap, kInputBuffer, kOutputBuffer };
+  enum {
+    kModel,
+    kInputTap,
+    kOutputTap,
+    kInputBuffer,
+    kOutputBuffer,
+    kPrecision
+  };
+  enum { kDouble, kSingle };
 
 public:
   using ParamDescType = decltype(MLPRegressorQueryParams);
@@ -316,17 +337,30 @@ public:
         return;
       auto outBuf = BufferAdaptor::Access(get<kOutputBuffer>().get());
       if (outBuf.samps(0).size() < outputSize) return;
+      BufferAdaptor::ReadAccess inBuf(get<kInputBuffer>().get());
 
-      RealVector src(inputSize);
-      RealVector dest(outputSize);
-      src = BufferAdaptor::ReadAccess(get<kInputBuffer>().get())
-                .samps(0, inputSize, 0);
-      algorithm.processFrame(src, dest, inputTap, outputTap);
-      outBuf.samps(0, outputSize, 0) = dest;
+      if (get<kPrecision>() == kSingle)
+      {
+        // straight between the buffers, with the single precision weights
+        algorithm.processFrame(inBuf.samps(0, inputSize, 0),
+                               outBuf.samps(0, outputSize, 0), inputTap,
+                               outputTap);
+        return;
+      }
+      // frames only reallocate when the taps change size
+      if (mSrc.size() != inputSize) mSrc.resize(inputSize);
+      if (mDest.size() != outputSize) mDest.resize(outputSize);
+      mSrc = inBuf.samps(0, inputSize, 0);
+      algorithm.processFrame(mSrc, mDest, inputTap, outputTap);
+      outBuf.samps(0, outputSize, 0) = mDest;
     }
   }
 
   index latency() { return 0; }
+
+private:
+  RealVector mSrc;
+  RealVector mDest;
 };
 
 } // namespace mlpregressor
@@ -45,7 +45,8 @@ enum NMFParamIndex {
   kEnvelopesUpdate,
   kRank,
   kIterations,
-  kFFT
+  kFFT,
+  kSeed
 };
 
 constexpr auto BufNMFParams = defineParameters(
@@ -63,7 +64,8 @@ constexpr auto BufNMFParams = defineParameters(
               "Fixed"),
     LongParam("components", "Number of Components", 1, Min(1)),
     LongParam("iterations", "Number of Iterations", 100, Min(1)),
-    FFTParam("fftSettings", "FFT Settings", 1024, -1, -1));
+    FFTParam("fftSettings", "FFT Settings", 1024, -1, -1),
+    LongParam("seed", "Random Seed (-1 for random)", -1, Min(-1)));
 
 class NMFClient : public FluidBaseClient, public OfflineIn, public OfflineOut
 {
@@ -240,7 +242,7 @@ public:
         }
       }
 
-      auto nmf = algorithm::NMF();
+      auto nmf = algorithm::NMF(get<kSeed>());
       nmf.addProgressCallback(
           [&c, &progressCount, progressTotal](const index) -> bool {
             return c.task() ? c.task()->processUpdate(
@@ -19,7 +19,8 @@ namespace pca {
 
 constexpr auto PCAParams = defineParameters(
     StringParam<Fixed<true>>("name", "Name"),
-    LongParam("numDimensions", "Target Number of Dimensions", 2, Min(1)));
+    LongParam("numDimensions", "Target Number of Dimensions", 2, Min(1)),
+    EnumParam("method", "Fit Method", 0, "Full", "Randomized"));
 
 class PCAClient : public FluidBaseClient,
                   OfflineIn,
@@ -27,7 +28,9 @@ class PCAClient : public FluidBaseClient,
                   ModelObject,
                   public DataClient<algorithm::PCA>
 {
-  enum { kName, kNumDimensions };
+  enum { kName, kNumDimensions, kMethod };
+
+  enum { kFull, kRandomized };
 
 public:
   using string = std::string;
@@ -63,7 +66,29 @@ public:
     if (!datasetClientPtr) return Error(NoDataSet);
     auto dataSet = datasetClientPtr->getDataSet();
     if (dataSet.size() == 0) return Error(EmptyDataSet);
-    mAlgorithm.init(dataSet.getData());
+    if (get<kMethod>() == kRandomized)
+      mAlgorithm.init(dataSet.getData(), get<kNumDimensions>());
+    else
+      mAlgorithm.init(dataSet.getData());
+    return OK();
+  }
+
+  // adds the points to those the model was fitted to, without refitting
+  MessageResult<void> partialFit(DataSetClientRef datasetClient)
+  {
+    auto datasetClientPtr = datasetClient.get().lock();
+    if (!datasetClientPtr) return Error(NoDataSet);
+    auto dataSet = datasetClientPtr->getDataSet();
+    if (dataSet.size() == 0) return Error(EmptyDataSet);
+    if (mAlgorithm.initialized())
+    {
+      if (dataSet.pointSize() != mAlgorithm.dims())
+        return Error(WrongPointSize);
+      if (mAlgorithm.numPoints() == 0)
+        return Error("Model has no point count to update, fit it again");
+    }
+    index k = get<kMethod>() == kRandomized ? get<kNumDimensions>() : 0;
+    mAlgorithm.update(dataSet.getData(), k);
     return OK();
   }
 
@@ -84,6 +109,7 @@ public:
     index k = get<kNumDimensions>();
     if (k <= 0) return Error<double>(SmallDim);
     if (k > mAlgorithm.dims()) return Error<double>(LargeDim);
+    if (k > mAlgorithm.size()) return Error<double>(LargeDim);
     auto   srcPtr = sourceClient.get().lock();
     auto   destPtr = destClient.get().lock();
     double result = 0;
@@ -106,6 +132,14 @@ public:
     {
       return Error<double>(NoDataSet);
     }
+    if (result < 0)
+    {
+      MessageResult<double> unknown{result};
+      unknown.set(Result::Status::kWarning);
+      unknown.addMessage("Fraction of variance unknown: the model only has "
+                         "the bases of a Randomized fit");
+      return unknown;
+    }
     return result;
   }
 
@@ -115,6 +149,7 @@ public:
     if (k <= 0) return Error(SmallDim);
     if (k > mAlgorithm.dims()) return Error(LargeDim);
     if (!mAlgorithm.initialized()) return Error(NoDataFitted);
+    if (k > mAlgorithm.size()) return Error(LargeDim);
     InOutBuffersCheck bufCheck(mAlgorithm.dims());
     if (!bufCheck.checkInputs(in.get(), out.get()))
       return Error(bufCheck.error());
@@ -133,6 +168,7 @@ public:
   {
     return defineMessages(
         makeMessage("fit", &PCAClient::fit),
+        makeMessage("partialFit", &PCAClient::partialFit),
         makeMessage("transform", &PCAClient::transform),
         makeMessage("fitTransform", &PCAClient::fitTransform),
         makeMessage("transformPoint", &PCAClient::transformPoint),
@@ -196,7 +232,7 @@ public:
       algorithm::PCA algorithm = PCAPtr->algorithm();
       if (!algorithm.initialized()) return;
       index k = get<kNumDimensions>();
-      if (k <= 0 || k > algorithm.dims()) return;
+      if (k <= 0 || k > algorithm.size()) return;
       InOutBuffersCheck bufCheck(algorithm.dims());
       if (!bufCheck.checkInputs(get<kInputBuffer>().get(),
                                 get<kOutputBuffer>().get()))
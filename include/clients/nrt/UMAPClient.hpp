@@ -24,7 +24,13 @@ constexpr auto UMAPParams = defineParameters(
     LongParam("numNeighbours", "Number of Nearest Neighbours", 15, Min(1)),
     FloatParam("minDist", "Minimum Distance", 0.1, Min(0)),
     LongParam("iterations", "Number of Iterations", 200, Min(1)),
-    FloatParam("learnRate", "Learning Rate", 0.1, Min(0.0), Max(1.0)));
+    FloatParam("learnRate", "Learning Rate", 0.1, Min(0.0), Max(1.0)),
+    EnumParam("neighbourSearch", "Nearest Neighbour Search", 0, "Exact",
+              "Approximate"),
+    LongParam("numThreads",
+              "Number of Threads (0 for all cores, layout on one if seeded)", 0,
+              Min(0)),
+    LongParam("seed", "Random Seed (-1 for random)", -1, Min(-1)));
 
 class UMAPClient : public FluidBaseClient,
                    OfflineIn,
@@ -38,7 +44,10 @@ class UMAPClient : public FluidBaseClient,
     kNumNeighbors,
     kMinDistance,
     kNumIter,
-    kLearningRate
+    kLearningRate,
+    kNeighbourSearch,
+    kNumThreads,
+    kSeed
   };
 
 public:
@@ -83,7 +92,8 @@ public:
     FluidDataSet<string, double, 1> result;
     result = mAlgorithm.train(src, get<kNumNeighbors>(), get<kNumDimensions>(),
                               get<kMinDistance>(), get<kNumIter>(),
-                              get<kLearningRate>());
+                              get<kLearningRate>(), get<kNeighbourSearch>(),
+                              get<kNumThreads>(), get<kSeed>());
     destPtr->setDataSet(result);
     return OK();
   }
@@ -100,7 +110,8 @@ public:
     FluidDataSet<string, double, 1> result;
     result = mAlgorithm.train(src, get<kNumNeighbors>(), get<kNumDimensions>(),
                               get<kMinDistance>(), get<kNumIter>(),
-                              get<kLearningRate>());
+                              get<kLearningRate>(), get<kNeighbourSearch>(),
+                              get<kNumThreads>(), get<kSeed>());
     return OK();
   }
 
@@ -119,7 +130,8 @@ public:
     if (src.pointSize() != mAlgorithm.inputDims()) return Error(WrongPointSize);
     StringVector                    ids{src.getIds()};
     FluidDataSet<string, double, 1> result;
-    result = mAlgorithm.transform(src, get<kNumIter>(), get<kLearningRate>());
+    result = mAlgorithm.transform(src, get<kNumIter>(), get<kLearningRate>(),
+                                  get<kNumThreads>(), get<kSeed>());
     destPtr->setDataSet(result);
     return OK();
   }
@@ -78,7 +78,7 @@ public:
 
   HPSSClient(ParamSetViewType& p)
       : mParams{p}, mSTFTBufferedProcess{get<kMaxFFT>(), 1, 3},
-        mHPSS{get<kMaxFFT>(), get<kMaxHSize>()}
+        mHPSS{get<kMaxFFT>(), get<kMaxHSize>(), get<kMaxPSize>()}
   {
     FluidBaseClient::audioChannelsIn(1);
     FluidBaseClient::audioChannelsOut(3);
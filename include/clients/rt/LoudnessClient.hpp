@@ -34,7 +34,7 @@ enum LoudnessParamIndex {
 
 constexpr auto LoudnessParams = defineParameters(
     EnumParam("kWeighting", "Apply K-Weighting", 1, "Off", "On"),
-    EnumParam("truePeak", "Compute True Peak", 1, "Off", "On"),
+    EnumParam("truePeak", "Compute True Peak", 1, "Off", "On", "On (FFT)"),
     LongParam("windowSize", "Window Size", 1024, UpperLimit<kMaxWindowSize>()),
     LongParam("hopSize", "Hop Size", 512, Min(1)),
     LongParam<Fixed<true>>("maxWindowSize", "Max Window Size", 16384, Min(4),
@@ -87,7 +87,7 @@ public:
       mBufferedProcess.maxSize(get<kWindowSize>(), get<kWindowSize>(),
                                FluidBaseClient::audioChannelsIn(),
                                FluidBaseClient::controlChannelsOut().size);
-      mAlgorithm.init(get<kWindowSize>(), sampleRate());
+      mAlgorithm.init(get<kWindowSize>(), sampleRate(), get<kHopSize>());
     }
     RealMatrix in(1, hostVecSize);
     in.row(0) = input[0];
@@ -96,7 +96,10 @@ public:
         get<kWindowSize>(), get<kHopSize>(), c, [&](RealMatrixView frame) {
           mAlgorithm.processFrame(frame.row(0), mDescriptors,
                                   get<kKWeighting>() == 1,
-                                  get<kTruePeak>() == 1);
+                                  get<kTruePeak>() != 0,
+                                  get<kTruePeak>() == 2
+                                      ? algorithm::TruePeak::kFFT
+                                      : algorithm::TruePeak::kPolyphase);
         });
     // output[0](0) = static_cast<T>(mDescriptors(0));
     // output[1](0) = static_cast<T>(mDescriptors(1));
@@ -108,7 +111,7 @@ public:
   void reset()
   {
     mBufferedProcess.reset();
-    mAlgorithm.init(get<kWindowSize>(), sampleRate());
+    mAlgorithm.init(get<kWindowSize>(), sampleRate(), get<kHopSize>());
   }
 
   index controlRate() { return get<kHopSize>(); }
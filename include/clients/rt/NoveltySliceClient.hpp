@@ -115,7 +115,7 @@ public:
     }
     else if (feature == 3)
     {
-      mLoudness.init(windowSize, sampleRate());
+      mLoudness.init(windowSize, sampleRate(), get<kFFT>().hopSize());
     }
     mFeature.resize(nDims);
     mNovelty.init(get<kKernelSize>(), get<kFilterSize>(), nDims);
@@ -134,7 +134,8 @@ public:
     index windowSize = get<kFFT>().winSize();
     index feature = get<kFeature>();
     if (mParamsTracker.changed(hostVecSize, get<kFeature>(), get<kKernelSize>(),
-                               get<kFilterSize>(), windowSize, sampleRate()))
+                               get<kFilterSize>(), windowSize,
+                               get<kFFT>().hopSize(), sampleRate()))
     {
       mBufferedProcess.hostSize(hostVecSize);
       mBufferedProcess.maxSize(windowSize, windowSize,
@@ -195,7 +196,7 @@ public:
 
 private:
   algorithm::NoveltySegmentation mNovelty;
-  ParameterTrackChanges<index, index, index, index, index, double>
+  ParameterTrackChanges<index, index, index, index, index, index, double>
                                        mParamsTracker;
   BufferedProcess                      mBufferedProcess;
   algorithm::STFT                      mSTFT;
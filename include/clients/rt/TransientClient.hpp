@@ -129,6 +129,29 @@ public:
     return get<kPadding>() + get<kBlockSize>() - get<kOrder>();
   }
 
+  // Offline segments, see processChannel(): the repaired residual is fed back
+  // into the extractor's analysis history, and is also the residual output, so
+  // that output over the history and the latency settles the state. Segments
+  // warm up for four more analysis histories before that, for clicks repaired
+  // from a fresh start to be out of the way
+  index segmentHistory() const
+  {
+    index order = get<kOrder>();
+    index blockSize = std::max(get<kBlockSize>(), order);
+    index padding = std::max(get<kPadding>(), order);
+    return order + blockSize + 2 * padding + padding + blockSize - order;
+  }
+
+  index segmentWarmup() const
+  {
+    index order = get<kOrder>();
+    index blockSize = std::max(get<kBlockSize>(), order);
+    index padding = std::max(get<kPadding>(), order);
+    return segmentHistory() + 4 * (order + blockSize + 2 * padding);
+  }
+
+  index segmentAlignment() const { return get<kBlockSize>() - get<kOrder>(); }
+
   void reset() { mBufferedProcess.reset(); }
 
 private:
@@ -143,7 +166,8 @@ using RTTransientClient = ClientWrapper<transient::TransientClient>;
 auto constexpr NRTTransientParams = makeNRTParams<transient::TransientClient>(
     InputBufferParam("source", "Source Buffer"),
     BufferParam("transients", "Transients Buffer"),
-    BufferParam("residual", "Residual Buffer"));
+    BufferParam("residual", "Residual Buffer"),
+    LongParam("numThreads", "Number of Threads", 1, Min(1)));
 
 using NRTTransientsClient =
     NRTStreamAdaptor<transient::TransientClient, decltype(NRTTransientParams),
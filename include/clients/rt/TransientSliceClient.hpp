@@ -136,6 +136,32 @@ public:
     return get<kPadding>() + get<kBlockSize>() - get<kOrder>();
   }
 
+  // Offline segments, see processChannel(): detection only looks at the
+  // analysis history, but a slice point holds the next ones back for the
+  // minimum slice length, so output over the history, the latency and that
+  // length settles the state. Segments warm up for four more analysis
+  // histories and that length before that, so that a slice point found from a
+  // fresh start does not hold back later ones
+  index segmentHistory() const
+  {
+    index order = get<kOrder>();
+    index blockSize = std::max(get<kBlockSize>(), order);
+    index padding = std::max(get<kPadding>(), order);
+    return order + blockSize + 2 * padding + padding + blockSize - order +
+           get<kMinSeg>();
+  }
+
+  index segmentWarmup() const
+  {
+    index order = get<kOrder>();
+    index blockSize = std::max(get<kBlockSize>(), order);
+    index padding = std::max(get<kPadding>(), order);
+    return segmentHistory() + 4 * (order + blockSize + 2 * padding) +
+           get<kMinSeg>();
+  }
+
+  index segmentAlignment() const { return get<kBlockSize>() - get<kOrder>(); }
+
   void reset()
   {
     mBufferedProcess.reset();
@@ -157,7 +183,8 @@ using RTTransientSliceClient =
 auto constexpr NRTTransientSliceParams =
     makeNRTParams<transientslice::TransientSliceClient>(
         InputBufferParam("source", "Source Buffer"),
-        BufferParam("indices", "Indices Buffer"));
+        BufferParam("indices", "Indices Buffer"),
+        LongParam("numThreads", "Number of Threads", 1, Min(1)));
 
 using NRTTransientSliceClient =
     NRTSliceAdaptor<transientslice::TransientSliceClient,
@@ -305,6 +305,7 @@ void to_json(nlohmann::json &j, const PCA &pca) {
   j["mean"] = RealVectorView(mean);
   j["rows"] = rows;
   j["cols"] = cols;
+  j["points"] = pca.numPoints();
 }
 
 bool check_json(const nlohmann::json &j, const PCA &) {
@@ -323,7 +324,9 @@ void from_json(const nlohmann::json &j, PCA &pca) {
   j.at("mean").get_to(mean);
   j.at("values").get_to(values);
   j.at("bases").get_to(bases);
-  pca.init(bases, values, mean);
+  // older models don't have the number of points, needed to update them
+  index points = j.contains("points") ? j.at("points").get<index>() : 0;
+  pca.init(bases, values, mean, points);
 }
 
 
@@ -0,0 +1,244 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks that HPSS gives exactly the output of the implementation that shifted
+its histories every frame, in each masking mode, and times both
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/public/HPSS.hpp>
+#include <algorithms/util/AlgorithmUtils.hpp>
+#include <algorithms/util/FluidEigenMappings.hpp>
+#include <algorithms/util/MedianFilter.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <data/TensorTypes.hpp>
+#include <Eigen/Core>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fluid::asUnsigned;
+using fluid::ComplexMatrix;
+using fluid::ComplexMatrixView;
+using fluid::ComplexVectorView;
+using fluid::index;
+using fluid::algorithm::HPSS;
+using fluid::algorithm::MedianFilter;
+using fluid::test::check;
+
+// HPSS as it was before its histories became rings: every frame moves the
+// whole history matrices along by one column, and allocates its masks
+class ShiftingHPSS
+{
+public:
+  using ArrayXd = Eigen::ArrayXd;
+  using ArrayXXd = Eigen::ArrayXXd;
+  using ArrayXcd = Eigen::ArrayXcd;
+  using ArrayXXcd = Eigen::ArrayXXcd;
+
+  void init(index nBins, index hSize)
+  {
+    mH = ArrayXXd::Zero(nBins, hSize);
+    mV = ArrayXXd::Zero(nBins, hSize);
+    mBuf = ArrayXXcd::Zero(nBins, hSize);
+    mHFilters = std::vector<MedianFilter>(asUnsigned(nBins));
+    for (index i = 0; i < nBins; i++) mHFilters[asUnsigned(i)].init(hSize);
+  }
+
+  void processFrame(const ComplexVectorView in, ComplexMatrixView out,
+                    index vSize, index hSize, index mode, double hThresholdX1,
+                    double hThresholdY1, double hThresholdX2,
+                    double hThresholdY2, double pThresholdX1,
+                    double pThresholdY1, double pThresholdX2,
+                    double pThresholdY2)
+  {
+    using namespace Eigen;
+    using fluid::algorithm::epsilon;
+    namespace _impl = fluid::algorithm::_impl;
+
+    index    h2 = (hSize - 1) / 2;
+    index    nBins = in.size();
+    ArrayXcd frame = _impl::asEigen<Array>(in);
+    ArrayXd  mag = frame.abs().real();
+
+    mV.block(0, 0, nBins, hSize - 1) = mV.block(0, 1, nBins, hSize - 1);
+    mH.block(0, 0, nBins, hSize - 1) = mH.block(0, 1, nBins, hSize - 1);
+    mBuf.block(0, 0, nBins, hSize - 1) = mBuf.block(0, 1, nBins, hSize - 1);
+
+    if (!mVFilter.initialized() || mVFilter.size() != vSize)
+      mVFilter.init(vSize);
+    mVFilter.process(mag, mV.col(hSize - 1), vSize - 1);
+    mBuf.block(0, hSize - 1, nBins, 1) = frame;
+    for (index i = 0; i < nBins; i++)
+      mH(i, h2 + 1) = mHFilters[asUnsigned(i)].processSample(mag(i));
+    ArrayXXcd result(nBins, 3);
+    ArrayXd   harmonicMask = ArrayXd::Ones(nBins);
+    ArrayXd   percussiveMask = ArrayXd::Ones(nBins);
+    ArrayXd   residualMask =
+        mode == HPSS::kAdvanced ? ArrayXd::Ones(nBins) : ArrayXd::Zero(nBins);
+    switch (mode)
+    {
+    case HPSS::kClassic: {
+      ArrayXd HV = mH.col(0) + mV.col(0);
+      ArrayXd mult = (1.0 / HV.max(epsilon));
+      harmonicMask = (mH.col(0) * mult);
+      percussiveMask = (mV.col(0) * mult);
+      break;
+    }
+    case HPSS::kCoupled: {
+      harmonicMask = ((mH.col(0) / mV.col(0)) >
+                      makeThreshold(nBins, hThresholdX1, hThresholdY1,
+                                    hThresholdX2, hThresholdY2))
+                         .cast<double>();
+      percussiveMask = 1 - harmonicMask;
+      break;
+    }
+    case HPSS::kAdvanced: {
+      harmonicMask = ((mH.col(0) / mV.col(0)) >
+                      makeThreshold(nBins, hThresholdX1, hThresholdY1,
+                                    hThresholdX2, hThresholdY2))
+                         .cast<double>();
+      percussiveMask = ((mV.col(0) / mH.col(0)) >
+                        makeThreshold(nBins, pThresholdX1, pThresholdY1,
+                                      pThresholdX2, pThresholdY2))
+                           .cast<double>();
+      residualMask = residualMask * (1 - harmonicMask);
+      residualMask = residualMask * (1 - percussiveMask);
+      ArrayXd maskNorm =
+          (1. / (harmonicMask + percussiveMask + residualMask)).max(epsilon);
+      harmonicMask = harmonicMask * maskNorm;
+      percussiveMask = percussiveMask * maskNorm;
+      residualMask = residualMask * maskNorm;
+      break;
+    }
+    }
+    result.col(0) = mBuf.col(0) * harmonicMask.min(1.0);
+    result.col(1) = mBuf.col(0) * percussiveMask.min(1.0);
+    result.col(2) = mBuf.col(0) * residualMask.min(1.0);
+    out = _impl::asFluid(result);
+  }
+
+private:
+  ArrayXd makeThreshold(index nBins, double x1, double y1, double x2,
+                        double y2)
+  {
+    ArrayXd threshold = ArrayXd::Ones(nBins);
+    index   kneeStart = static_cast<index>(std::floor(x1 * nBins));
+    index   kneeEnd = static_cast<index>(std::floor(x2 * nBins));
+    index   kneeLength = kneeEnd - kneeStart;
+    threshold.segment(0, kneeStart) =
+        ArrayXd::Constant(kneeStart, 10).pow(y1 / 20.0);
+    threshold.segment(kneeStart, kneeLength) =
+        ArrayXd::Constant(kneeLength, 10)
+            .pow(ArrayXd::LinSpaced(kneeLength, y1, y2) / 20.0);
+    threshold.segment(kneeEnd, nBins - kneeEnd) =
+        ArrayXd::Constant(nBins - kneeEnd, 10).pow(y2 / 20.0);
+    return threshold;
+  }
+
+  std::vector<MedianFilter> mHFilters;
+  MedianFilter              mVFilter;
+  ArrayXXd                  mV;
+  ArrayXXd                  mH;
+  ArrayXXcd                 mBuf;
+};
+
+const char* modeNames[] = {"classic", "coupled", "advanced"};
+
+// frames of random complex bins, with some steady partials so that the
+// harmonic and percussive masks both have something to find
+std::vector<ComplexMatrix> makeFrames(index nFrames, index nBins)
+{
+  std::mt19937                           gen(17);
+  std::uniform_real_distribution<double> noise(0, 1), phase(0, 6.28);
+  std::vector<ComplexMatrix>             frames;
+  for (index f = 0; f < nFrames; f++)
+  {
+    ComplexMatrix frame(1, nBins);
+    for (index i = 0; i < nBins; i++)
+    {
+      double mag =
+          noise(gen) * (f % 13 == 0 ? 8 : 1) + (i % 20 == 0 ? 10 : 0);
+      frame(0, i) = std::polar(mag, phase(gen));
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// thresholds in dB, with knees partway up the spectrum
+template <typename T>
+void process(T& hpss, ComplexMatrix& frame, ComplexMatrix& out, index mode)
+{
+  hpss.processFrame(frame.row(0), out, 31, 17, mode, 0.1, -3, 0.5, 3, 0.2, 0,
+                    0.7, -6);
+}
+
+void testAgainstShifting()
+{
+  index nBins = 513, nFrames = 200;
+  auto  frames = makeFrames(nFrames, nBins);
+  for (index mode : {HPSS::kClassic, HPSS::kCoupled, HPSS::kAdvanced})
+  {
+    HPSS          hpss(1024, 101, 101);
+    ShiftingHPSS  shifting;
+    ComplexMatrix out(nBins, 3), expected(nBins, 3);
+    hpss.init(nBins, 17);
+    shifting.init(nBins, 17);
+    bool same = true;
+    for (auto& frame : frames)
+    {
+      process(hpss, frame, out, mode);
+      process(shifting, frame, expected, mode);
+      for (index i = 0; i < nBins; i++)
+        for (index j = 0; j < 3; j++)
+          same = same && out(i, j) == expected(i, j);
+    }
+    std::printf("%s: ", modeNames[mode]);
+    check(same, "output is exactly that of the shifting implementation");
+  }
+}
+
+void testSpeed()
+{
+  index nBins = 1025, nFrames = 2000;
+  auto  frames = makeFrames(nFrames, nBins);
+  for (index mode : {HPSS::kClassic, HPSS::kCoupled, HPSS::kAdvanced})
+  {
+    HPSS          hpss(2048, 101, 101);
+    ShiftingHPSS  shifting;
+    ComplexMatrix out(nBins, 3);
+    hpss.init(nBins, 17);
+    shifting.init(nBins, 17);
+    double ringMs = fluid::test::timeMs([&] {
+      for (auto& frame : frames) process(hpss, frame, out, mode);
+    });
+    double shiftingMs = fluid::test::timeMs([&] {
+      for (auto& frame : frames) process(shifting, frame, out, mode);
+    });
+    std::printf("%s, FFT 2048: %.1f us per frame, shifting %.1f us\n",
+                modeNames[mode], 1000 * ringMs / nFrames,
+                1000 * shiftingMs / nFrames);
+  }
+}
+
+} // namespace
+
+int main()
+{
+  testAgainstShifting();
+  testSpeed();
+  return fluid::test::result();
+}
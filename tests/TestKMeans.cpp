@@ -0,0 +1,219 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks KMeans with Hamerly's bounds against plain Lloyd iterations from the
+same means, mini-batch training against full-batch training, and batched
+predict and transform against single points
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/public/KMeans.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <data/TensorTypes.hpp>
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace {
+
+using fluid::FluidTensor;
+using fluid::index;
+using fluid::RealMatrix;
+using fluid::algorithm::KMeans;
+using fluid::test::check;
+using DataSet = fluid::FluidDataSet<std::string, double, 1>;
+
+// normally distributed points around random centres, which may be close
+// enough together that clusters overlap
+DataSet makeData(index n, index d, double spread, Eigen::MatrixXd& centres)
+{
+  std::mt19937                     gen(23);
+  std::normal_distribution<double> normal;
+  for (index c = 0; c < centres.rows(); c++)
+    for (index j = 0; j < d; j++) centres(c, j) = spread * normal(gen);
+  FluidTensor<std::string, 1> ids(n);
+  RealMatrix                  data(n, d);
+  for (index i = 0; i < n; i++)
+  {
+    ids(i) = std::to_string(i);
+    for (index j = 0; j < d; j++)
+      data(i, j) = centres(i % centres.rows(), j) + normal(gen);
+  }
+  return DataSet(ids, data);
+}
+
+template <typename Matrix>
+Eigen::MatrixXd asMatrix(const Matrix& m)
+{
+  Eigen::MatrixXd result(m.rows(), m.cols());
+  for (index i = 0; i < m.rows(); i++)
+    for (index j = 0; j < m.cols(); j++) result(i, j) = m(i, j);
+  return result;
+}
+
+index nearest(const Eigen::MatrixXd& means, const Eigen::MatrixXd& data,
+              index i)
+{
+  index  best = 0;
+  double minDistance = std::numeric_limits<double>::infinity();
+  for (index k = 0; k < means.rows(); k++)
+  {
+    double dist = (data.row(i) - means.row(k)).squaredNorm();
+    if (dist < minDistance)
+    {
+      minDistance = dist;
+      best = k;
+    }
+  }
+  return best;
+}
+
+// Lloyd's algorithm, comparing every point with every mean, until no
+// assignment changes
+void lloyd(const Eigen::MatrixXd& data, Eigen::MatrixXd& means,
+           Eigen::VectorXi& assignments)
+{
+  index n = data.rows(), k = means.rows();
+  assignments.resize(n);
+  for (index i = 0; i < n; i++)
+    assignments(i) = static_cast<int>(nearest(means, data, i));
+  for (bool changed = true; changed;)
+  {
+    Eigen::MatrixXd sums = Eigen::MatrixXd::Zero(k, data.cols());
+    Eigen::VectorXd counts = Eigen::VectorXd::Zero(k);
+    for (index i = 0; i < n; i++)
+    {
+      sums.row(assignments(i)) += data.row(i);
+      counts(assignments(i))++;
+    }
+    for (index c = 0; c < k; c++)
+      if (counts(c) > 0) means.row(c) = sums.row(c) / counts(c);
+    changed = false;
+    for (index i = 0; i < n; i++)
+    {
+      int a = static_cast<int>(nearest(means, data, i));
+      changed = changed || a != assignments(i);
+      assignments(i) = a;
+    }
+  }
+}
+
+// sum of squared distances from each point to its nearest mean
+double inertia(const Eigen::MatrixXd& data, const Eigen::MatrixXd& means)
+{
+  double total = 0;
+  for (index i = 0; i < data.rows(); i++)
+    total += (data.row(i) - means.row(nearest(means, data, i))).squaredNorm();
+  return total;
+}
+
+void testAgainstLloyd()
+{
+  index           k = 12;
+  Eigen::MatrixXd centres(8, 10);
+  DataSet         dataset = makeData(5000, 10, 2, centres);
+  Eigen::MatrixXd data = asMatrix(dataset.getData());
+  Eigen::MatrixXd means = data.topRows(k);
+  Eigen::VectorXi assignments;
+  lloyd(data, means, assignments);
+
+  for (index threads : {1, 4})
+  {
+    KMeans     kmeans;
+    RealMatrix initial(k, data.cols()), trained(k, data.cols());
+    initial = dataset.getData()(fluid::Slice(0, k), fluid::Slice(0));
+    kmeans.setMeans(initial);
+    kmeans.train(dataset, k, 1000, 0, 0, threads);
+    kmeans.getMeans(trained);
+    FluidTensor<index, 1> hamerly(data.rows());
+    kmeans.getAssignments(hamerly);
+    index wrong = 0;
+    for (index i = 0; i < data.rows(); i++)
+      if (hamerly(i) != assignments(i)) wrong++;
+    check(wrong == 0, "Hamerly's bounds give the assignments of Lloyd's");
+    check((asMatrix(trained) - means).cwiseAbs().maxCoeff() < 1e-9,
+          "Hamerly's bounds give the means of Lloyd's");
+  }
+}
+
+// well separated clusters, which mini-batch training should find about as
+// well as the centres they were drawn around
+void testMiniBatch()
+{
+  index           k = 8;
+  Eigen::MatrixXd centres(k, 10);
+  DataSet         dataset = makeData(20000, 10, 4, centres);
+  Eigen::MatrixXd data = asMatrix(dataset.getData());
+  KMeans          miniBatch, again;
+  RealMatrix      means(k, data.cols()), againMeans(k, data.cols());
+  miniBatch.train(dataset, k, 200, 256, 0, 1, 1);
+  miniBatch.getMeans(means);
+  again.train(dataset, k, 200, 256, 0, 4, 1);
+  again.getMeans(againMeans);
+  double trueInertia = inertia(data, centres);
+  double miniInertia = inertia(data, asMatrix(means));
+  std::printf("inertia of centres %.0f, mini-batch %.0f\n", trueInertia,
+              miniInertia);
+  check(miniInertia < 1.02 * trueInertia,
+        "mini-batch inertia is within 2% of that of the true centres");
+  check(asMatrix(means) == asMatrix(againMeans),
+        "seeded mini-batch training does not depend on numThreads");
+}
+
+// predict and transform on blocks of rows, with 1 and 4 threads, against
+// one point at a time
+void testBatched()
+{
+  index           k = 6;
+  Eigen::MatrixXd centres(k, 8);
+  DataSet         dataset = makeData(3000, 8, 3, centres);
+  Eigen::MatrixXd data = asMatrix(dataset.getData());
+  KMeans          kmeans;
+  kmeans.train(dataset, k, 50, 0, 0, 1, 5);
+  RealMatrix means(k, data.cols());
+  kmeans.getMeans(means);
+  Eigen::MatrixXd meanMatrix = asMatrix(means);
+  for (index threads : {1, 4})
+  {
+    FluidTensor<index, 1> assignments(data.rows());
+    RealMatrix            distances(data.rows(), k);
+    kmeans.vq(dataset.getData(), assignments, threads);
+    kmeans.getDistances(dataset.getData(), distances, threads);
+    index  wrong = 0;
+    double maxError = 0;
+    for (index i = 0; i < data.rows(); i++)
+    {
+      if (assignments(i) != kmeans.vq(dataset.getData().row(i))) wrong++;
+      for (index c = 0; c < k; c++)
+      {
+        double d = (data.row(i) - meanMatrix.row(c)).squaredNorm();
+        maxError = std::max(maxError, std::abs(distances(i, c) - d));
+      }
+    }
+    check(wrong == 0, "batched predict matches predicting each point");
+    check(maxError < 1e-9, "batched transform gives the squared distances");
+  }
+}
+
+} // namespace
+
+int main()
+{
+  testAgainstLloyd();
+  testMiniBatch();
+  testBatched();
+  return fluid::test::result();
+}
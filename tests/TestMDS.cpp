@@ -0,0 +1,97 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks landmark MDS against classical MDS, in shape and in scale
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/public/MDS.hpp>
+#include <algorithms/util/DistanceFuncs.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <data/TensorTypes.hpp>
+#include <Eigen/Dense>
+#include <cmath>
+#include <random>
+
+namespace {
+
+using fluid::index;
+using fluid::RealMatrix;
+using fluid::algorithm::DistanceFuncs;
+using fluid::algorithm::MDS;
+using fluid::test::check;
+using Eigen::VectorXd;
+
+// points on a plane through 10-d space, spread twice as far along one
+// axis of the plane as along the other, so that the two leading components
+// are well apart
+RealMatrix makePlane(index n)
+{
+  std::mt19937                           gen(41);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  std::normal_distribution<double>       normal;
+  Eigen::MatrixXd                        basis(10, 2);
+  for (index i = 0; i < basis.size(); i++) basis(i) = normal(gen);
+  Eigen::HouseholderQR<Eigen::MatrixXd> qr(basis);
+  basis = qr.householderQ() * Eigen::MatrixXd::Identity(10, 2);
+  RealMatrix points(n, 10);
+  for (index i = 0; i < n; i++)
+  {
+    VectorXd p = 2 * uniform(gen) * basis.col(0) +
+                 uniform(gen) * basis.col(1) + VectorXd::Constant(10, 2);
+    for (index j = 0; j < 10; j++) points(i, j) = p(j);
+  }
+  return points;
+}
+
+VectorXd column(const RealMatrix& m, index c)
+{
+  VectorXd result(m.rows());
+  for (index i = 0; i < m.rows(); i++) result(i) = m(i, c);
+  return result;
+}
+
+void testAgainstClassical(DistanceFuncs::Distance distance, const char* name)
+{
+  index      n = 1500, k = 2;
+  RealMatrix points = makePlane(n);
+  RealMatrix classical(n, k), landmark(n, k);
+  MDS        mds;
+  mds.process(points, classical, static_cast<index>(distance), k);
+  mds.process(points, landmark, static_cast<index>(distance), k, 100);
+  double minCorrelation = 1, maxScaleError = 0;
+  for (index c = 0; c < k; c++)
+  {
+    VectorXd a = column(classical, c), b = column(landmark, c);
+    a.array() -= a.mean();
+    b.array() -= b.mean();
+    // components have arbitrary signs, and the best-fit scale takes it
+    double scale = a.dot(b) / b.squaredNorm();
+    minCorrelation = std::min(
+        minCorrelation, std::abs(a.dot(b)) / (a.norm() * b.norm()));
+    maxScaleError = std::max(maxScaleError, std::abs(std::abs(scale) - 1));
+  }
+  std::printf("%s: correlation %.4f, scale error %.3f\n", name,
+              minCorrelation, maxScaleError);
+  check(minCorrelation > 0.99, "landmark MDS has the shape of classical MDS");
+  check(maxScaleError < 0.03, "landmark MDS has the scale of classical MDS");
+}
+
+} // namespace
+
+int main()
+{
+  testAgainstClassical(DistanceFuncs::Distance::kEuclidean, "euclidean");
+  testAgainstClassical(DistanceFuncs::Distance::kManhattan, "manhattan");
+  testAgainstClassical(DistanceFuncs::Distance::kSqEuclidean, "squared");
+  return fluid::test::result();
+}
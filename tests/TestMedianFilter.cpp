@@ -0,0 +1,109 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks the sliding median filter against sorting each window
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/util/MedianFilter.hpp>
+#include <data/FluidIndex.hpp>
+#include <Eigen/Core>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fluid::asSigned;
+using fluid::asUnsigned;
+using fluid::index;
+using fluid::algorithm::MedianFilter;
+using fluid::test::check;
+
+// median of the last size samples of a stream that starts with zeros
+class NaiveMedian
+{
+public:
+  explicit NaiveMedian(index size) : mWindow(asUnsigned(size), 0) {}
+
+  double processSample(double val)
+  {
+    mWindow.pop_front();
+    mWindow.push_back(val);
+    std::vector<double> sorted(mWindow.begin(), mWindow.end());
+    auto middle = sorted.begin() + asSigned(sorted.size() / 2);
+    std::nth_element(sorted.begin(), middle, sorted.end());
+    return *middle;
+  }
+
+private:
+  std::deque<double> mWindow;
+};
+
+// random samples, drawn from few enough values that there are many ties
+std::vector<double> makeSignal(std::mt19937& gen, index length, int levels)
+{
+  std::uniform_int_distribution<int> level(-levels, levels);
+  std::vector<double>                signal(asUnsigned(length));
+  for (auto& x : signal) x = level(gen) / static_cast<double>(levels);
+  return signal;
+}
+
+void testSamples()
+{
+  std::mt19937 gen(17);
+  MedianFilter filter(101);
+  index        wrong = 0;
+  for (index size : {3, 5, 7, 31, 101})
+  {
+    for (int levels : {2, 1000})
+    {
+      auto        signal = makeSignal(gen, 2000, levels);
+      NaiveMedian naive(size);
+      filter.init(size);
+      for (double x : signal)
+        if (filter.processSample(x) != naive.processSample(x)) wrong++;
+    }
+  }
+  check(wrong == 0, "sliding median matches the sorted window");
+}
+
+void testBlock()
+{
+  std::mt19937 gen(19);
+  index        size = 9, delay = 4, length = 500;
+  auto         signal = makeSignal(gen, length, 10);
+  MedianFilter filter(size);
+  filter.init(size);
+  // a first block, so that process() has to start again from zeros
+  Eigen::ArrayXd input =
+      Eigen::Map<Eigen::ArrayXd>(signal.data(), length), output(length);
+  filter.process(input, output, delay);
+  filter.process(input, output, delay);
+  NaiveMedian naive(size);
+  index       wrong = 0;
+  for (index i = 0; i < length + delay; i++)
+  {
+    double median = naive.processSample(i < length ? input(i) : 0);
+    if (i >= delay && output(i - delay) != median) wrong++;
+  }
+  check(wrong == 0, "block median matches the sorted window, delayed");
+}
+
+} // namespace
+
+int main()
+{
+  testSamples();
+  testBlock();
+  return fluid::test::result();
+}
@@ -0,0 +1,113 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks the recall of the NN-descent neighbour graph against brute-force
+search
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/util/NNDescent.hpp>
+#include <data/FluidIndex.hpp>
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fluid::asUnsigned;
+using fluid::index;
+using fluid::algorithm::NNDescent;
+using fluid::test::check;
+using ArrayXXd =
+    Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using ArrayXXi =
+    Eigen::Array<index, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// clusters of normally distributed points, whose spread varies between
+// dimensions, as with MFCCs; a single cluster is the hardest case
+ArrayXXd makeData(index n, index d, index clusters)
+{
+  std::mt19937                     gen(29);
+  std::normal_distribution<double> normal;
+  ArrayXXd                         centres(clusters, d), data(n, d);
+  for (index i = 0; i < centres.size(); i++) centres(i) = 3 * normal(gen);
+  for (index i = 0; i < n; i++)
+    for (index j = 0; j < d; j++)
+      data(i, j) = centres(i % clusters, j) + normal(gen) / (1 + 0.1 * j);
+  return data;
+}
+
+// the k nearest neighbours of each point, by comparing it with every other
+ArrayXXi bruteForce(const ArrayXXd& data, index k)
+{
+  index              n = data.rows();
+  ArrayXXi           indices(n, k);
+  std::vector<index> order(asUnsigned(n));
+  Eigen::ArrayXd     distances(n);
+  for (index i = 0; i < n; i++)
+  {
+    distances = (data.rowwise() - data.row(i)).square().rowwise().sum();
+    distances(i) = std::numeric_limits<double>::infinity();
+    std::iota(order.begin(), order.end(), 0);
+    std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                      [&](index a, index b) {
+                        return distances(a) < distances(b);
+                      });
+    for (index j = 0; j < k; j++) indices(i, j) = order[asUnsigned(j)];
+  }
+  return indices;
+}
+
+void testRecall(index clusters)
+{
+  index    n = 3000, k = 15;
+  ArrayXXd data = makeData(n, 40, clusters);
+  ArrayXXi exact = bruteForce(data, k);
+  ArrayXXi indices(n, k);
+  ArrayXXd distances(n, k);
+  NNDescent nnDescent(1);
+  nnDescent.process(data, k, indices, distances);
+
+  index found = 0, wrongDistances = 0;
+  for (index i = 0; i < n; i++)
+  {
+    for (index j = 0; j < k; j++)
+    {
+      index neighbour = indices(i, j);
+      for (index l = 0; l < k; l++)
+        if (exact(i, l) == neighbour) found++;
+      double dist =
+          std::sqrt((data.row(i) - data.row(neighbour)).square().sum());
+      if (neighbour == i || std::abs(dist - distances(i, j)) > 1e-9 ||
+          (j > 0 && distances(i, j) < distances(i, j - 1)))
+        wrongDistances++;
+    }
+  }
+  double recall = static_cast<double>(found) / (n * k);
+  std::printf("%lld clusters: recall %.4f\n",
+              static_cast<long long>(clusters), recall);
+  check(recall >= 0.9, "NN-descent finds 90% of the nearest neighbours");
+  check(wrongDistances == 0,
+        "NN-descent gives the distances to its neighbours, nearest first");
+}
+
+} // namespace
+
+int main()
+{
+  testRecall(20);
+  testRecall(1);
+  return fluid::test::result();
+}
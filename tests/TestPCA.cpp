@@ -0,0 +1,142 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks the randomized and incremental PCA fits against the full one
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/public/PCA.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <data/TensorTypes.hpp>
+#include <cmath>
+#include <random>
+
+namespace {
+
+using fluid::index;
+using fluid::RealMatrix;
+using fluid::RealVector;
+using fluid::algorithm::PCA;
+using fluid::test::check;
+
+// normally distributed points, whose j-th column has standard deviation
+// decay^j, around a mean away from the origin
+RealMatrix makeData(index n, index d, double decay)
+{
+  std::mt19937                     gen(3);
+  std::normal_distribution<double> normal;
+  RealMatrix                       data(n, d);
+  for (index i = 0; i < n; i++)
+    for (index j = 0; j < d; j++)
+      data(i, j) = normal(gen) * std::pow(decay, j) + 5;
+  return data;
+}
+
+void testAccuracy()
+{
+  index      k = 5;
+  RealMatrix data = makeData(2000, 60, 0.9);
+  PCA        full, randomized;
+  full.init(data);
+  randomized.init(data, k);
+  double valueError = 0, vectorError = 0;
+  for (index i = 0; i < k; i++)
+  {
+    valueError = std::max(valueError, std::abs(randomized.mValues(i) -
+                                               full.mValues(i)));
+    vectorError = std::max(
+        vectorError,
+        1 - std::abs(randomized.mBases.col(i).dot(full.mBases.col(i))));
+  }
+  check(valueError <= 1e-5 * full.mValues(0),
+        "randomized singular values match the full fit");
+  check(vectorError <= 1e-6, "randomized bases match the full fit");
+  check(randomized.truncated() && !full.truncated(),
+        "only the randomized model is truncated");
+
+  RealMatrix out(data.rows(), k);
+  double     fraction = full.process(data, out, k);
+  check(fraction > 0 && fraction <= 1,
+        "full model gives the fraction of variance");
+  check(randomized.process(data, out, k) < 0,
+        "truncated model does not claim a fraction of variance");
+}
+
+// the largest differences between the k leading singular values (relative to
+// the first) and bases (as 1 - |cos|) of two models
+void compare(const PCA& a, const PCA& b, index k, double& valueError,
+             double& vectorError)
+{
+  valueError = 0;
+  vectorError = 0;
+  for (index i = 0; i < k; i++)
+  {
+    valueError = std::max(valueError, std::abs(a.mValues(i) - b.mValues(i)) /
+                                          b.mValues(0));
+    vectorError = std::max(
+        vectorError, 1 - std::abs(a.mBases.col(i).dot(b.mBases.col(i))));
+  }
+}
+
+// the data in batches, each shifted so that the mean moves between them
+void testIncremental()
+{
+  index      n = 2000, d = 30, batch = 250;
+  RealMatrix data = makeData(n, d, 0.8);
+  for (index i = 0; i < n; i++)
+    for (index j = 0; j < d; j++) data(i, j) += 0.001 * (i / batch);
+  PCA full, incremental, truncated;
+  full.init(data);
+  for (index start = 0; start < n; start += batch)
+  {
+    auto rows = data(fluid::Slice(start, batch), fluid::Slice(0));
+    incremental.update(rows);
+    truncated.update(rows, 5);
+  }
+  double valueError, vectorError;
+  compare(incremental, full, d, valueError, vectorError);
+  check(valueError <= 1e-10 && vectorError <= 1e-10,
+        "incremental PCA keeping every basis matches the full fit");
+  RealVector fullMean(d), mean(d);
+  full.getMean(fullMean);
+  incremental.getMean(mean);
+  double meanError = 0;
+  for (index j = 0; j < d; j++)
+    meanError = std::max(meanError, std::abs(mean(j) - fullMean(j)));
+  check(meanError <= 1e-12 && incremental.numPoints() == n,
+        "incremental PCA has the mean and size of the full fit");
+
+  compare(truncated, full, 5, valueError, vectorError);
+  std::printf("incremental, 5 bases: value error %.2e, vector error %.2e\n",
+              valueError, vectorError);
+  check(valueError <= 1e-2 && vectorError <= 1e-2,
+        "incremental PCA keeping 5 bases approximates the full fit");
+}
+
+void testSpeed()
+{
+  RealMatrix data = makeData(20000, 300, 0.97);
+  PCA        full, randomized;
+  double     fullMs = fluid::test::timeMs([&] { full.init(data); });
+  double randomizedMs = fluid::test::timeMs([&] { randomized.init(data, 5); });
+  std::printf("full %.0f ms, randomized %.0f ms\n", fullMs, randomizedMs);
+}
+
+} // namespace
+
+int main()
+{
+  testAccuracy();
+  testIncremental();
+  testSpeed();
+  return fluid::test::result();
+}
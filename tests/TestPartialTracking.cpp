@@ -0,0 +1,196 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks the sparse pairing of peaks against Munkres on the full cost matrix
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/util/Munkres.hpp>
+#include <algorithms/util/PeakAssignment.hpp>
+#include <data/FluidIndex.hpp>
+#include <Eigen/Core>
+#include <cmath>
+#include <random>
+
+namespace {
+
+using fluid::asSigned;
+using fluid::asUnsigned;
+using fluid::index;
+using fluid::algorithm::Munkres;
+using fluid::algorithm::PeakAssignment;
+using fluid::test::check;
+using ArrayXb = Eigen::Array<bool, Eigen::Dynamic, 1>;
+
+struct Problem
+{
+  Eigen::ArrayXd prevFreqs, prevAmps, freqs, amps;
+  double         varF, varA, delta;
+};
+
+// a frame of peaks, and the next one, where most peaks have drifted a little,
+// some have died and others are born
+Problem makeProblem(std::mt19937& gen, index size, double zetaF, double zetaA,
+                    double delta)
+{
+  std::uniform_real_distribution<double> freq(20, 20000), amp(-90, 0),
+      unit(0, 1);
+  std::normal_distribution<double> drift;
+  Problem                          p;
+  p.prevFreqs.resize(size);
+  p.prevAmps.resize(size);
+  for (index i = 0; i < size; i++)
+  {
+    p.prevFreqs(i) = freq(gen);
+    p.prevAmps(i) = amp(gen);
+  }
+  std::vector<double> freqs, amps;
+  for (index i = 0; i < size; i++)
+  {
+    if (unit(gen) < 0.1) continue;
+    freqs.push_back(p.prevFreqs(i) + zetaF * drift(gen));
+    amps.push_back(p.prevAmps(i) + 3 * drift(gen));
+  }
+  std::uniform_int_distribution<index> born(0, size / 5);
+  for (index i = born(gen); i > 0; i--)
+  {
+    freqs.push_back(freq(gen));
+    amps.push_back(amp(gen));
+  }
+  p.freqs = Eigen::Map<Eigen::ArrayXd>(freqs.data(), asSigned(freqs.size()));
+  p.amps = Eigen::Map<Eigen::ArrayXd>(amps.data(), asSigned(amps.size()));
+  double scale = -std::log((delta - 1) / (delta - 2));
+  p.varF = zetaF * zetaF * scale;
+  p.varA = zetaA * zetaA * scale;
+  p.delta = delta;
+  return p;
+}
+
+double cost(const Problem& p, index i, index j, bool& useful)
+{
+  double dF = p.prevFreqs(i) - p.freqs(j), dA = p.prevAmps(i) - p.amps(j);
+  double u = 1 - std::exp(-(dF * dF) / p.varF - dA * dA / p.varA);
+  double s = 1 - (1 - p.delta) * u;
+  useful = u < s;
+  return useful ? u : s;
+}
+
+void solveDense(const Problem& p, Eigen::ArrayXi& assignment, ArrayXb& useful)
+{
+  index           N = p.prevFreqs.size(), M = p.freqs.size();
+  Eigen::ArrayXXd costs(N, M);
+  bool            isUseful;
+  for (index i = 0; i < N; i++)
+    for (index j = 0; j < M; j++) costs(i, j) = cost(p, i, j, isUseful);
+  Munkres munkres;
+  munkres.init(N, M);
+  assignment.resize(N);
+  munkres.process(costs, assignment);
+  useful.setConstant(N, false);
+  for (index i = 0; i < N; i++)
+  {
+    if (assignment(i) >= M)
+      assignment(i) = -1;
+    else
+      cost(p, i, assignment(i), useful(i));
+  }
+}
+
+void solveSparse(PeakAssignment& solver, const Problem& p,
+                 Eigen::ArrayXi& assignment, ArrayXb& useful)
+{
+  assignment.resize(p.prevFreqs.size());
+  useful.resize(p.prevFreqs.size());
+  solver.process(p.prevFreqs, p.prevAmps, p.freqs, p.amps, p.varF, p.varA,
+                 p.delta, assignment, useful);
+}
+
+double totalCost(const Problem& p, const Eigen::ArrayXi& assignment)
+{
+  double total = 0;
+  bool   useful;
+  for (index i = 0; i < assignment.size(); i++)
+    if (assignment(i) >= 0) total += cost(p, i, assignment(i), useful);
+  return total;
+}
+
+bool isMatching(const Eigen::ArrayXi& assignment, index cols)
+{
+  std::vector<bool> taken(asUnsigned(cols), false);
+  index             assigned = 0;
+  for (index i = 0; i < assignment.size(); i++)
+  {
+    index j = assignment(i);
+    if (j < 0) continue;
+    if (j >= cols || taken[asUnsigned(j)]) return false;
+    taken[asUnsigned(j)] = true;
+    assigned++;
+  }
+  return assigned == std::min(assignment.size(), cols);
+}
+
+void testAgainstDense()
+{
+  std::mt19937   gen(5);
+  PeakAssignment solver;
+  index          wrongCost = 0, wrongPairs = 0, notMatching = 0;
+  const double   settings[][3] = {
+      {50, 15, 0.5}, {50, 15, 0.2}, {200, 30, 0.8}, {10, 5, 0.5}};
+  for (auto& s : settings)
+  {
+    for (index trial = 0; trial < 50; trial++)
+    {
+      index   size = 1 + trial * 2;
+      Problem p = makeProblem(gen, size, s[0], s[1], s[2]);
+      Eigen::ArrayXi denseAssignment, sparseAssignment;
+      ArrayXb        denseUseful, sparseUseful;
+      solveDense(p, denseAssignment, denseUseful);
+      solveSparse(solver, p, sparseAssignment, sparseUseful);
+      if (!isMatching(sparseAssignment, p.freqs.size())) notMatching++;
+      if (std::abs(totalCost(p, sparseAssignment) -
+                   totalCost(p, denseAssignment)) > 1e-9)
+        wrongCost++;
+      for (index i = 0; i < size; i++)
+      {
+        bool denseHas = denseUseful(i), sparseHas = sparseUseful(i);
+        if (denseHas != sparseHas ||
+            (denseHas && denseAssignment(i) != sparseAssignment(i)))
+          wrongPairs++;
+      }
+    }
+  }
+  check(notMatching == 0, "sparse pairing assigns every peak of one frame");
+  check(wrongCost == 0, "sparse pairing has the total cost of the dense one");
+  check(wrongPairs == 0, "sparse pairing makes the same useful pairs");
+}
+
+void testSpeed()
+{
+  std::mt19937   gen(7);
+  Problem        p = makeProblem(gen, 400, 50, 15, 0.5);
+  PeakAssignment solver;
+  Eigen::ArrayXi denseAssignment, sparseAssignment;
+  ArrayXb        denseUseful, sparseUseful;
+  double         denseMs = fluid::test::timeMs(
+      [&] { solveDense(p, denseAssignment, denseUseful); });
+  double sparseMs = fluid::test::timeMs(
+      [&] { solveSparse(solver, p, sparseAssignment, sparseUseful); });
+  std::printf("dense %.1f ms, sparse %.1f ms\n", denseMs, sparseMs);
+}
+
+} // namespace
+
+int main()
+{
+  testAgainstDense();
+  testSpeed();
+  return fluid::test::result();
+}
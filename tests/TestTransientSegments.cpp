@@ -0,0 +1,109 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks that offline transient extraction and slicing in segments give exactly
+the output of a single pass
+*/
+
+#include "TestUtils.hpp"
+#include <clients/common/FluidTask.hpp>
+#include <clients/common/MemoryBufferAdaptor.hpp>
+#include <clients/rt/TransientClient.hpp>
+#include <clients/rt/TransientSliceClient.hpp>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fluid::index;
+using fluid::test::check;
+using fluid::client::BufferAdaptor;
+using fluid::client::MemoryBufferAdaptor;
+
+// a drifting sine in noise, with clicks at the given density
+std::shared_ptr<BufferAdaptor> makeSource(index length, double density)
+{
+  auto                                  source =
+      std::make_shared<MemoryBufferAdaptor>(1, length, 44100);
+  std::mt19937                          gen(1);
+  std::normal_distribution<float>       noise;
+  std::uniform_real_distribution<float> unit;
+  auto                                  samples = source->samps(0);
+  double                                phase = 0;
+  for (index i = 0; i < length; i++)
+  {
+    phase += 0.03 + 0.01 * std::sin(i * 1e-5);
+    samples(i) = 0.3f * static_cast<float>(std::sin(phase)) + 0.01f * noise(gen);
+    if (unit(gen) < density) samples(i) += (unit(gen) - 0.5f) * 1.5f;
+  }
+  return source;
+}
+
+std::vector<float> contents(const std::shared_ptr<BufferAdaptor>& buffer)
+{
+  BufferAdaptor::ReadAccess access(buffer.get());
+  std::vector<float>        samples;
+  for (index i = 0; i < access.numFrames(); i++)
+    samples.push_back(access.samps(0)(i));
+  return samples;
+}
+
+// Client's outputs for a source, with its numThreads parameter set to threads
+template <typename Client, size_t NumOutputs>
+std::vector<std::vector<float>>
+run(const std::shared_ptr<BufferAdaptor>& source, index threads)
+{
+  using namespace fluid::client;
+  constexpr size_t firstOutput = 5;
+  constexpr size_t threadsParam = firstOutput + NumOutputs;
+
+  typename Client::ParamSetType params(Client::getParameterDescriptors());
+  Client                        client(params);
+  params.template set<0>(std::shared_ptr<const BufferAdaptor>(source), nullptr);
+  std::vector<std::shared_ptr<BufferAdaptor>> outputs;
+  for (size_t i = 0; i < NumOutputs; i++)
+    outputs.push_back(std::make_shared<MemoryBufferAdaptor>(1, 1, 44100));
+  params.template set<firstOutput>(
+      std::shared_ptr<BufferAdaptor>(outputs[0]), nullptr);
+  params.template set<firstOutput + NumOutputs - 1>(
+      std::shared_ptr<BufferAdaptor>(outputs[NumOutputs - 1]), nullptr);
+  params.template set<threadsParam>(index(threads), nullptr);
+
+  fluid::FluidTask task;
+  FluidContext     context(task);
+  client.template process<float>(context);
+  std::vector<std::vector<float>> result;
+  for (auto& out : outputs) result.push_back(contents(out));
+  return result;
+}
+
+void testSegments(double density, const char* what)
+{
+  using namespace fluid::client;
+  auto source = makeSource(44100 * 10, density);
+  check(run<NRTTransientsClient, 2>(source, 8) ==
+            run<NRTTransientsClient, 2>(source, 1),
+        what);
+  check(run<NRTTransientSliceClient, 1>(source, 8) ==
+            run<NRTTransientSliceClient, 1>(source, 1),
+        what);
+}
+
+} // namespace
+
+int main()
+{
+  testSegments(0.0005, "8 segments match a single pass, with sparse clicks");
+  testSegments(0.005, "8 segments match a single pass, with dense clicks");
+  return fluid::test::result();
+}
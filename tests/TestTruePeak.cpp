@@ -0,0 +1,146 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks the polyphase true peak of a stream of frames against the FFT method,
+and that peaks between frames are found
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/util/TruePeak.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <data/TensorTypes.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fluid::index;
+using fluid::RealVector;
+using fluid::RealVectorView;
+using fluid::algorithm::TruePeak;
+using fluid::test::check;
+
+const double pi = 3.14159265358979323846;
+
+// a few tones with a whole number of cycles per period, up to maxBin, so that
+// every window of one period is periodic and the FFT method is exact
+std::vector<double> makeTones(std::mt19937& gen, index length, index period,
+                              index maxBin)
+{
+  std::uniform_int_distribution<index>   bin(1, maxBin);
+  std::uniform_real_distribution<double> phase(0, 2 * pi), amp(0.1, 1);
+  std::vector<double>                    signal(fluid::asUnsigned(length), 0);
+  for (index tone = 0; tone < 3; tone++)
+  {
+    double w = 2 * pi * bin(gen) / period, p = phase(gen), a = amp(gen);
+    for (index i = 0; i < length; i++)
+      signal[fluid::asUnsigned(i)] += a * std::cos(w * i + p);
+  }
+  return signal;
+}
+
+// the largest peak over the frames of signal, size long and hop apart
+double streamPeak(TruePeak& truePeak, const std::vector<double>& signal,
+                  index size, index hop, index method)
+{
+  RealVector frame(size);
+  double     peak = 0;
+  for (index start = 0; start + size <= fluid::asSigned(signal.size());
+       start += hop)
+  {
+    for (index i = 0; i < size; i++)
+      frame(i) = signal[fluid::asUnsigned(start + i)];
+    peak = std::max(peak, truePeak.processFrame(frame, method));
+  }
+  return peak;
+}
+
+double dB(double x) { return 20 * std::log10(x); }
+
+void testAgainstFFT()
+{
+  std::mt19937 gen(11);
+  index        size = 1024;
+  TruePeak     truePeak(size);
+  double       maxError = 0;
+  for (index hop : {size, size / 2})
+  {
+    for (index trial = 0; trial < 50; trial++)
+    {
+      // content up to 0.45 of the sample rate
+      auto signal = makeTones(gen, 8 * size, size, size * 45 / 100);
+      truePeak.init(size, 44100, hop);
+      double polyphase = streamPeak(truePeak, signal, size, hop,
+                                    TruePeak::kPolyphase);
+      truePeak.init(size, 44100, hop);
+      double fft = streamPeak(truePeak, signal, size, hop, TruePeak::kFFT);
+      maxError = std::max(maxError, std::abs(dB(polyphase) - dB(fft)));
+    }
+  }
+  std::printf("max error against FFT method %.3f dB\n", maxError);
+  check(maxError < 0.5, "polyphase true peak is within 0.5 dB of the FFT one");
+}
+
+// a burst at a quarter of the sample rate, peaking halfway between the last
+// sample of one frame and the first of the next, where the samples are 3 dB
+// below the true peak
+void testFrameEdges()
+{
+  index               size = 1024;
+  std::vector<double> signal(fluid::asUnsigned(4 * size), 0);
+  double              centre = 2 * size - 0.5;
+  for (index i = 0; i < 4 * size; i++)
+  {
+    double t = i - centre;
+    if (std::abs(t) < 100)
+      signal[fluid::asUnsigned(i)] =
+          std::cos(pi / 2 * t) * 0.5 * (1 + std::cos(pi * t / 100));
+  }
+  TruePeak truePeak(size);
+  for (index hop : {size, size / 2, size / 4})
+  {
+    truePeak.init(size, 44100, hop);
+    double peak =
+        streamPeak(truePeak, signal, size, hop, TruePeak::kPolyphase);
+    check(dB(peak) > -0.1, "true peak between frames is found");
+  }
+}
+
+void testSpeed()
+{
+  std::mt19937 gen(13);
+  index        size = 1024, hop = 512;
+  auto         signal = makeTones(gen, 200 * size, size, size * 45 / 100);
+  TruePeak     truePeak(size);
+  double       peak = 0;
+  truePeak.init(size, 44100, hop);
+  double polyphaseMs = fluid::test::timeMs([&] {
+    peak += streamPeak(truePeak, signal, size, hop, TruePeak::kPolyphase);
+  });
+  truePeak.init(size, 44100, hop);
+  double fftMs = fluid::test::timeMs([&] {
+    peak += streamPeak(truePeak, signal, size, hop, TruePeak::kFFT);
+  });
+  std::printf("399 frames: polyphase %.1f ms, FFT %.1f ms (%.2f)\n",
+              polyphaseMs, fftMs, peak);
+}
+
+} // namespace
+
+int main()
+{
+  testAgainstFFT();
+  testFrameEdges();
+  testSpeed();
+  return fluid::test::result();
+}
@@ -0,0 +1,134 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks the randomized truncated eigensolver and SVD against dense ones
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/util/TruncatedEigen.hpp>
+#include <algorithms/util/TruncatedSVD.hpp>
+#include <data/FluidIndex.hpp>
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+using fluid::asUnsigned;
+using fluid::index;
+using fluid::algorithm::TruncatedEigen;
+using fluid::algorithm::TruncatedSVD;
+using fluid::test::check;
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+MatrixXd randomOrthonormal(std::mt19937& gen, index rows, index cols)
+{
+  std::normal_distribution<double> normal;
+  MatrixXd                         M(rows, cols);
+  for (index i = 0; i < M.size(); i++) M(i) = normal(gen);
+  Eigen::HouseholderQR<MatrixXd> qr(M);
+  return qr.householderQ() * MatrixXd::Identity(rows, cols);
+}
+
+// largest difference between values, relative to the first, and largest
+// angle (as 1 - |cos|) between corresponding vectors, whose signs are arbitrary
+void compare(const VectorXd& values, const MatrixXd& vectors,
+             const VectorXd& reference, const MatrixXd& referenceVectors,
+             double& valueError, double& vectorError)
+{
+  index k = values.size();
+  valueError = (values - reference.head(k)).cwiseAbs().maxCoeff() /
+               std::abs(reference(0));
+  vectorError = 0;
+  for (index i = 0; i < k; i++)
+    vectorError = std::max(
+        vectorError,
+        1 - std::abs(vectors.col(i).dot(referenceVectors.col(i))));
+}
+
+// a symmetric matrix with eigenvalues +-decay^i, of alternating signs, so
+// that those of largest magnitude are not the largest ones
+void testEigen(index n, index k, double decay)
+{
+  std::mt19937 gen(31);
+  MatrixXd     V = randomOrthonormal(gen, n, n);
+  VectorXd     lambda(n);
+  for (index i = 0; i < n; i++)
+    lambda(i) = std::pow(decay, i) * (i % 2 ? -1 : 1);
+  MatrixXd A = V * lambda.asDiagonal() * V.transpose();
+  A = 0.5 * (A + A.transpose());
+
+  Eigen::SelfAdjointEigenSolver<MatrixXd> dense(A);
+  std::vector<index>                      order(asUnsigned(n));
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](index a, index b) {
+    return std::abs(dense.eigenvalues()(a)) > std::abs(dense.eigenvalues()(b));
+  });
+  VectorXd reference(n);
+  MatrixXd referenceVectors(n, n);
+  for (index i = 0; i < n; i++)
+  {
+    reference(i) = dense.eigenvalues()(order[asUnsigned(i)]);
+    referenceVectors.col(i) = dense.eigenvectors().col(order[asUnsigned(i)]);
+  }
+
+  TruncatedEigen truncated;
+  truncated.compute(A, k);
+  double valueError, vectorError;
+  compare(truncated.eigenvalues(), truncated.eigenvectors(), reference,
+          referenceVectors, valueError, vectorError);
+  std::printf("eigen n %lld k %lld: value error %.2e, vector error %.2e\n",
+              static_cast<long long>(n), static_cast<long long>(k), valueError,
+              vectorError);
+  check(valueError <= 1e-6, "truncated eigenvalues match the dense solver");
+  check(vectorError <= 1e-6, "truncated eigenvectors match the dense solver");
+}
+
+// points whose j-th column has standard deviation decay^j, around a mean away
+// from the origin, which the offset removes
+void testSVD(index n, index d, index k, double decay)
+{
+  std::mt19937                     gen(37);
+  std::normal_distribution<double> normal;
+  MatrixXd                         A(n, d);
+  for (index i = 0; i < n; i++)
+    for (index j = 0; j < d; j++)
+      A(i, j) = normal(gen) * std::pow(decay, j) + 5;
+  VectorXd offset = A.colwise().mean();
+  MatrixXd centred = A.rowwise() - offset.transpose();
+
+  Eigen::BDCSVD<MatrixXd> dense(centred, Eigen::ComputeThinV);
+  TruncatedSVD            truncated;
+  truncated.compute(A, offset, k);
+  double valueError, vectorError;
+  compare(truncated.singularValues(), truncated.matrixV(),
+          dense.singularValues(), dense.matrixV(), valueError, vectorError);
+  std::printf("svd %lld x %lld k %lld: value error %.2e, vector error %.2e\n",
+              static_cast<long long>(n), static_cast<long long>(d),
+              static_cast<long long>(k), valueError, vectorError);
+  check(valueError <= 1e-6, "truncated singular values match the dense SVD");
+  check(vectorError <= 1e-6, "truncated singular vectors match the dense SVD");
+}
+
+} // namespace
+
+int main()
+{
+  testEigen(400, 5, 0.8);
+  testEigen(30, 10, 0.8); // solved directly
+  testSVD(2000, 200, 5, 0.9);
+  testSVD(500, 30, 10, 0.9); // exact in one pass
+  return fluid::test::result();
+}
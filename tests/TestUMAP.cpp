@@ -0,0 +1,75 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+/*
+Checks that seeded UMAP fits and transforms are reproducible when asked for
+several threads
+*/
+
+#include "TestUtils.hpp"
+#include <algorithms/public/UMAP.hpp>
+#include <data/FluidDataSet.hpp>
+#include <data/FluidIndex.hpp>
+#include <data/FluidTensor.hpp>
+#include <data/TensorTypes.hpp>
+#include <random>
+#include <string>
+
+namespace {
+
+using fluid::index;
+using fluid::RealMatrix;
+using fluid::algorithm::UMAP;
+using fluid::test::check;
+
+// points scattered around a few centres in 8-d space
+UMAP::DataSet makeClusters(index n, unsigned seed)
+{
+  std::mt19937                     gen(seed);
+  std::normal_distribution<double> normal;
+  UMAP::DataSet                    ds(8);
+  fluid::RealVector                point(8);
+  for (index i = 0; i < n; i++)
+  {
+    for (index j = 0; j < 8; j++) point(j) = normal(gen) + 4 * ((i % 4) == j);
+    ds.add(std::to_string(i), point);
+  }
+  return ds;
+}
+
+bool same(const UMAP::DataSet& a, const UMAP::DataSet& b)
+{
+  auto x = a.getData(), y = b.getData();
+  if (x.rows() != y.rows() || x.cols() != y.cols()) return false;
+  for (index i = 0; i < x.rows(); i++)
+    for (index j = 0; j < x.cols(); j++)
+      if (x(i, j) != y(i, j)) return false;
+  return true;
+}
+
+void testSeededThreads()
+{
+  UMAP::DataSet in = makeClusters(600, 3), query = makeClusters(200, 5);
+  UMAP          first, second;
+  UMAP::DataSet a = first.train(in, 15, 2, 0.1, 100, 1.0, UMAP::kExact, 4, 7);
+  UMAP::DataSet b = second.train(in, 15, 2, 0.1, 100, 1.0, UMAP::kExact, 4, 7);
+  check(same(a, b), "seeded fits on 4 threads give the same embedding");
+  a = first.transform(query, 100, 1.0, 4, 7);
+  b = second.transform(query, 100, 1.0, 4, 7);
+  check(same(a, b), "seeded transforms on 4 threads give the same embedding");
+}
+
+} // namespace
+
+int main()
+{
+  testSeededThreads();
+  return fluid::test::result();
+}
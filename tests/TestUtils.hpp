@@ -0,0 +1,46 @@
+/*
+Part of the Fluid Corpus Manipulation Project (http://www.flucoma.org/)
+Copyright 2017-2019 University of Huddersfield.
+Licensed under the BSD-3 License.
+See license.md file in the project root for full license information.
+This project has received funding from the European Research Council (ERC)
+under the European Union’s Horizon 2020 research and innovation programme
+(grant agreement No 725899).
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+namespace fluid {
+namespace test {
+
+inline int& failures()
+{
+  static int count = 0;
+  return count;
+}
+
+inline void check(bool passed, const char* what)
+{
+  std::printf("%s: %s\n", passed ? "ok" : "FAILED", what);
+  if (!passed) failures()++;
+}
+
+/// Milliseconds taken by f()
+template <typename Func>
+double timeMs(Func&& f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/// The test's exit code
+inline int result() { return failures() > 0 ? 1 : 0; }
+
+} // namespace test
+} // namespace fluid